@@ -1,11 +1,54 @@
+// Build: gcc -O2 -pthread ccdstru2.0.c -o ccdstru2.0 -lm
+// posix_memalign needs POSIX.1-2001 under -std=c11; glibc hides madvise and MAP_HUGETLB
+// from strict POSIX builds unless _DEFAULT_SOURCE is set too
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#else
+#include <io.h>
+#include <malloc.h>
+#endif
 
 // Define constants
 #define GRID_SIZE 4
 #define MAX_POSITIONS 16
+#define NUM_PATTERNS 3
+#define PATTERN_LENGTH 4
+#define FULL_MASK ((SetMask)((1u << MAX_POSITIONS) - 1))
+#define INPUT_BUFFER_SIZE 65536
+#define RECORD_MAX_MOVES 65535
+#define RECORD_KEYFRAME_INTERVAL 32
+#define RECORD_PROBLEMS_KEPT 1000
+#define SEARCH_MAX_PLY 64
+#define SEARCH_MAX_THREADS 64
+#define TABLE_BUCKET_ENTRIES 4
+#define MCTS_MAX_DEPTH 128
+#define PLAYOUT_MAX_PLIES 300
+#define SIMULATION_MAX_PLIES 1000
+#define HISTORY_MAX_MOVES 1024
+#define UNDO_STACK_SIZE 1024
+#define FRAME_BUFFER_SIZE 16384
+#define BOARD_MIN_SIZE 4
+#define BOARD_MAX_SIZE 8
+#define VIEW_MAX_LINES 12
+#define VIEW_LINE_LENGTH 256
+#define MONITOR_MAX_BOARDS 24
 
 // Structure to represent a position
 typedef struct {
@@ -13,11 +56,47 @@ typedef struct {
     int y;
 } Position;
 
+// Occupancy mask with one bit per grid cell (bit (x-1)*GRID_SIZE + (y-1))
+typedef uint16_t SetMask;
+
+#if MAX_POSITIONS > 16
+#error "SetMask is too narrow for MAX_POSITIONS"
+#endif
+
+#if NUM_PATTERNS > 8
+#error "cellPatterns is too narrow for NUM_PATTERNS"
+#endif
+
+// Which set of the game a PositionSet is, selecting its row of Zobrist keys
+#define SET_UNO 0
+#define SET_TRES 1
+#define SET_FREE 2
+
+#ifndef ARRAY_POSITION_SETS
+// Define sets as occupancy masks (build with -DARRAY_POSITION_SETS for the array backend)
+typedef struct {
+    SetMask bits;
+    uint8_t patternCounts[NUM_PATTERNS];    // Cells of each winning pattern in the set
+    uint8_t completePatterns;               // Winning patterns fully in the set
+    uint8_t owner;                          // SET_UNO, SET_TRES or SET_FREE
+    uint64_t key;                           // XOR of the Zobrist keys of the set's cells
+} PositionSet;
+#else
 // Define sets as arrays of positions that tracks the size
 typedef struct {
     Position positions[MAX_POSITIONS];
     int size;
+    uint8_t patternCounts[NUM_PATTERNS];    // Cells of each winning pattern in the set
+    uint8_t completePatterns;               // Winning patterns fully in the set
+    uint8_t owner;                          // SET_UNO, SET_TRES or SET_FREE
+    uint64_t key;                           // XOR of the Zobrist keys of the set's cells
 } PositionSet;
+#endif
+
+// Position keys of a game, indexed by the number of moves played before the position
+typedef struct {
+    uint64_t keys[HISTORY_MAX_MOVES + 1];
+} PositionHistory;
 
 // Game state
 typedef struct {
@@ -27,26 +106,455 @@ typedef struct {
     bool turn;
     bool go;
     bool over;
+    uint64_t turnKey;    // Zobrist keys of turn and go; positionKey adds the sets' keys
+    uint32_t moveCount;           // Moves played since initializeGame
+    PositionHistory* history;     // Earlier positions, or NULL when repetitions are not tracked
 } GameState;
 
+// What applyMove changed, enough for undoMove to restore the state
+typedef struct {
+    int8_t cell;
+    uint8_t owner;    // Set the cell was in before the move: SET_UNO, SET_TRES or SET_FREE
+    bool turn;
+    bool go;
+    bool over;
+} UndoEntry;
+
+// Moves that undoMove can take back, most recent last
+typedef struct {
+    UndoEntry entries[UNDO_STACK_SIZE];
+    int size;
+} UndoStack;
+
+// Optional rule ending games without a winner; 0 turns a limit off
+typedef struct {
+    int repetitions;    // Draw when a position occurs this many times (needs a history)
+    int maxMoves;       // Draw when this many moves have been played
+} DrawRule;
+
+// Whose move it is: Tres (turn, !go), Uno (turn, go) or Dos (!turn)
+typedef enum {
+    PHASE_TRES,
+    PHASE_UNO,
+    PHASE_DOS
+} Phase;
+
+#define NUM_PHASES 3
+
+// Winner of a position (OUTCOME_NONE while nobody has won or can force a win)
+typedef enum {
+    OUTCOME_NONE,
+    OUTCOME_UNO,
+    OUTCOME_TRES,
+    OUTCOME_DOS
+} Outcome;
+
+// State of a xoshiro256** random number generator
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+// Outcome of every state, labelled by the retrograde solver
+typedef struct {
+    uint8_t* outcomes;     // 2 bits per state, four states per byte
+    uint8_t* distances;    // Plies until the labelled winner wins under best play
+} SolverTable;
+
+// Header of an outcome tablebase file; the packed outcomes start at TABLEBASE_PAYLOAD_OFFSET
+typedef struct {
+    char magic[8];                 // "CCDSTRTB"
+    uint32_t version;
+    uint32_t gridSize;
+    uint32_t numPatterns;
+    uint32_t patternLength;
+    uint32_t stateCount;
+    uint32_t reserved;
+    uint64_t payloadBytes;
+    uint64_t checksum;             // FNV-1a of the payload
+    uint8_t patternCells[64];      // Cell index of every winningPatterns entry, pattern by pattern
+} TablebaseHeader;
+
+// A tablebase file mapped into memory
+typedef struct {
+    void* map;
+    size_t mapSize;
+    TablebaseHeader* header;
+    uint8_t* outcomes;             // Same packing as SolverTable.outcomes
+} Tablebase;
+
+// Input read in large chunks, for the game loop and the move text tools
+typedef struct {
+    int fd;               // File descriptor read with read()
+    FILE* file;           // Stream read with fread() instead, on Windows
+    char data[INPUT_BUFFER_SIZE];
+    size_t position;      // Next unread byte
+    size_t length;        // Bytes in data
+    uint64_t consumed;    // Bytes read from the input so far
+    bool ended;
+} InputBuffer;
+
+// Streaming writer for binary game records; buffers one game at a time
+typedef struct {
+    FILE* file;
+    GameState game;                      // Game being recorded, used for keyframes
+    int moveCount;
+    uint8_t moves[(RECORD_MAX_MOVES + 1) / 2];   // 4-bit cell indices, low nibble first
+    uint8_t keyframes[RECORD_MAX_MOVES / RECORD_KEYFRAME_INTERVAL * 4];
+} RecordWriter;
+
+// Reader walking the records of a mapped game record file
+typedef struct {
+    uint8_t* map;
+    size_t size;
+    size_t offset;                       // Offset of the next record
+} RecordReader;
+
+// One game record, pointing into the reader's mapping
+typedef struct {
+    size_t offset;                       // Offset of the record in the file
+    int moveCount;
+    Outcome result;                      // Winner recorded by the writer
+    uint8_t* moves;
+    uint8_t* keyframes;                  // Uno and Tres masks after every RECORD_KEYFRAME_INTERVAL moves
+} GameRecord;
+
+// Problem found in one archived game
+typedef struct {
+    size_t offset;       // Offset of the record in the file
+    int kind;            // RECORD_ILLEGAL_MOVE, RECORD_BAD_KEYFRAME or RECORD_WRONG_RESULT
+    int move;            // Move number (from 1) or keyframe number the problem was found at
+} RecordProblem;
+
+// One thread's share of a record validation run
+typedef struct {
+    RecordReader* reader;
+    size_t* offsets;     // Record offsets, shared by all shards
+    size_t first;
+    size_t last;
+    uint64_t moves;
+    uint64_t badGames;
+    RecordProblem* problems;    // The first RECORD_PROBLEMS_KEPT problems of the shard
+    int problemCount;
+} ValidatorShard;
+
+// Transposition table entry; check is the position key XORed with data, so an entry
+// torn by two threads writing at once fails validation instead of being misread
+typedef struct {
+    uint64_t check;
+    uint64_t data;       // Value, depth, bound, best cell and generation (see packTableData)
+} TableEntry;
+
+// Entries sharing one 64-byte cache line, so a probe touches a single line
+typedef struct {
+    _Alignas(64) TableEntry entries[TABLE_BUCKET_ENTRIES];
+} TableBucket;
+
+// Transposition table shared without locks by every search thread and computer seat
+typedef struct {
+    TableBucket* buckets;
+    uint64_t bucketMask;
+    size_t bytes;
+    int backing;         // TABLE_HUGE_PAGES, TABLE_TRANSPARENT_HUGE_PAGES or TABLE_PLAIN_PAGES
+    uint8_t generation;  // Advanced by each root search so older entries are replaced first
+} SharedTable;
+
+// Search engine playing one seat; the other two seats are assumed to play against it
+typedef struct {
+    Outcome seat;
+    SharedTable* table;
+    uint64_t seatKey;                      // Mixed into position keys so seats never share values
+    uint64_t nodes;
+    double deadline;
+    bool stopped;
+    bool* stopAll;                         // Raised to stop helper threads; NULL for the main thread
+    int rootMove;                          // Best cell of the last completed root search
+} SearchEngine;
+
+// A helper thread of a Lazy SMP search, filling the shared table for the main thread
+typedef struct {
+    SearchEngine engine;
+    GameState game;
+    int firstDepth;
+    int maxDepth;
+} SearchHelper;
+
+// Tree node of the Monte Carlo search; the children of a node are a run of the arena
+typedef struct {
+    uint32_t firstChild;   // Arena index of the first child, 0 until the node is expanded
+    uint32_t visits;
+    float reward;          // Summed playout rewards of the player who moved into the node
+    int8_t cell;           // Move leading to the node
+    uint8_t childCount;
+} MctsNode;
+
+// Monte Carlo search player; the arena holds the tree of the current move only
+typedef struct {
+    MctsNode* nodes;
+    uint32_t used;
+    uint32_t capacity;
+    Rng rng;
+    uint64_t playouts;     // Playouts run by the last search
+} MctsPlayer;
+
+// Results of simulated games
+typedef struct {
+    uint64_t wins[4];       // Games won by each player; OUTCOME_NONE counts games stopped by the move cap
+    uint64_t moves;
+    uint64_t lengths[SIMULATION_MAX_PLIES + 1];    // Games by number of moves played
+} SimulationStats;
+
+// A board of the simulation monitor; one worker thread stores packed states in it
+typedef struct {
+    _Alignas(64) uint64_t state;    // packMonitorState's word, or 0 before the first store
+} MonitorSlot;
+
+// Live view of a simulation: the boards workers publish to and how far they are
+typedef struct {
+    MonitorSlot slots[MONITOR_MAX_BOARDS];
+    int boards;
+    int threads;           // Publishing workers; worker t owns boards t, t + threads, ...
+    uint64_t gamesDone;    // Added to once per chunk, after the chunk's last store
+} SimulationMonitor;
+
+// One simulator thread; it claims chunks of games from a shared counter
+typedef struct {
+    uint64_t* nextChunk;
+    uint64_t games;
+    uint64_t seed;
+    bool heuristic;
+    SimulationMonitor* monitor;    // Boards to publish games to, or NULL
+    int thread;
+    SimulationStats stats;    // Written once, when the thread is done
+} SimulationWorker;
+
+// Code specialized for one board size, made by DEFINE_BOARD_KERNEL
+typedef struct {
+    int size;
+    void* (*simulate)(void* arg);    // Runs a SimulationWorker, like runSimulationWorker
+    uint64_t (*perft)(uint64_t uno, uint64_t tres, Phase phase, int depth);
+} BoardKernel;
+
+// A perft run on a board of another size, split by root cell like PerftRun
+typedef struct {
+    const BoardKernel* kernel;
+    uint64_t counts[BOARD_MAX_SIZE * BOARD_MAX_SIZE];    // Paths below each root cell
+    int cellCount;
+    int nextCell;
+    int depth;
+} BoardPerftRun;
+
+// A perft run shared by its threads, which claim root moves one at a time
+typedef struct {
+    GameState root;
+    Position moves[MAX_POSITIONS];
+    uint64_t counts[MAX_POSITIONS];    // Paths below each root move
+    int moveCount;
+    int nextMove;
+    int depth;
+    SharedTable* table;    // Subtree counts, or NULL
+} PerftRun;
+
+// Text of one screen, built in full before it is written
+typedef struct {
+    char data[FRAME_BUFFER_SIZE];
+    size_t length;
+} FrameBuffer;
+
+// What the differential renderer last drew for one board, and where
+typedef struct {
+    int row;                 // Terminal row and column of the board's top-left corner, from 1
+    int column;
+    bool drawn;              // false until the board has been drawn in full once
+    uint8_t cells[MAX_POSITIONS];                     // SET_UNO, SET_TRES or SET_FREE
+    char lines[VIEW_MAX_LINES][VIEW_LINE_LENGTH];    // Status and move list lines below the grid
+    int lineCount;
+} BoardView;
+
+// One thread of a root-parallel Monte Carlo search, growing its own tree
+typedef struct {
+    MctsPlayer* player;
+    GameState* game;
+    uint64_t playouts;
+    double seconds;
+} MctsWorker;
+
+// One thread's share of a solver sweep over a range of bitset words
+typedef struct {
+    SolverTable* table;
+    Outcome player;
+    uint8_t* counts;
+    uint64_t* frontier;
+    uint64_t* next;
+    int level;
+    bool shared;         // Other threads update the same arrays, so use atomics
+    uint32_t firstWord;
+    uint32_t lastWord;
+    uint64_t reached;    // States won by the player in this range
+} SolverSweep;
+
 // Function prototypes
 void initializeGame(GameState* game);
+int positionToCell(Position pos);
+Position cellToPosition(int cell);
+void trackCellChange(PositionSet* set, int cell, int delta);
+void initializeZobristKeys();
+uint64_t positionKey(GameState* game);
 bool positionInSet(Position pos, PositionSet set);
 void addPositionToSet(Position pos, PositionSet* set);
 void removePositionFromSet(Position pos, PositionSet* set);
+int setSize(PositionSet set);
+SetMask setToMask(PositionSet set);
+int setPositions(PositionSet set, Position out[MAX_POSITIONS]);
+void initializeWinningMasks();
+bool maskHasWinningPattern(SetMask mask);
 bool checkWinningPattern(PositionSet playerSet);
+void trackHistory(GameState* game, PositionHistory* history);
+bool checkDrawRule(GameState* game);
 void checkGameOver(GameState* game);
 bool nextPlayerMove(GameState* game, Position pos);
+bool applyMove(GameState* game, Position pos, UndoStack* stack);
+bool undoMove(GameState* game, UndoStack* stack);
+Phase gamePhase(GameState* game);
+void setGamePosition(GameState* game, SetMask uno, SetMask tres, Phase phase);
+Outcome phasePlayer(Phase phase);
+Outcome maskOutcome(SetMask uno, SetMask tres);
+Outcome gameWinner(GameState* game);
+int legalMoves(GameState* game, Position out[MAX_POSITIONS]);
+bool playMove(GameState* game, Position pos);
+double wallSeconds();
+int cpuCount();
+void seedRandom(Rng* rng, uint64_t seed);
+uint64_t nextRandom(Rng* rng);
+uint32_t randomBelow(Rng* rng, uint32_t bound);
+int randomMoveCell(GameState* game, Rng* rng);
+Outcome playRandomGame(GameState* game, Rng* rng, int maxPlies);
+void initializeStateIndex();
+uint32_t stateIndex(SetMask uno, SetMask tres, Phase phase);
+void indexToState(uint32_t index, SetMask* uno, SetMask* tres, Phase* phase);
+uint32_t gameStateIndex(GameState* game);
+void initializeStateRanking();
+bool stateIsRankable(SetMask uno, SetMask tres, Phase phase);
+uint32_t rankState(SetMask uno, SetMask tres, Phase phase);
+void unrankState(uint32_t rank, SetMask* uno, SetMask* tres, Phase* phase);
+uint32_t rankGameState(GameState* game);
+void unrankGameState(uint32_t rank, GameState* game);
+int runSelfTest(int games);
+void initializeSymmetries();
+void canonicalizeState(SetMask uno, SetMask tres, SetMask* canonicalUno, SetMask* canonicalTres);
+uint32_t canonicalGameIndex(GameState* game);
+int runSymmetryReport();
+Outcome unpackOutcome(uint8_t* outcomes, uint32_t index);
+Outcome probeOutcome(SolverTable* table, uint32_t index);
+bool solveGame(SolverTable* table, int threadCount);
+void freeSolverTable(SolverTable* table);
+bool solverBestMove(SolverTable* table, GameState* game, Position* move);
+int runSolver(int threadCount);
+int runSolverBenchmark(int maxThreads);
+void* mapFile(const char* path, size_t* size);
+void unmapFile(void* map, size_t size);
+bool writeTablebase(SolverTable* table, const char* path);
+bool openTablebase(Tablebase* tb, const char* path);
+void closeTablebase(Tablebase* tb);
+Outcome probeTablebase(Tablebase* tb, uint32_t index);
+bool verifyTablebase(Tablebase* tb);
+int runBuildTablebase(const char* path, int threadCount);
+int runProbeTablebase(const char* path);
+bool openInput(InputBuffer* input, const char* path);
+void closeInput(InputBuffer* input);
+bool fillInput(InputBuffer* input);
+int readInputByte(InputBuffer* input);
+int peekInputByte(InputBuffer* input);
+void skipInputLine(InputBuffer* input);
+bool inputHasMove(InputBuffer* input);
+int readInteger(InputBuffer* input, int* value);
+int readCoordinates(InputBuffer* input, int* x, int* y);
+int readMoveToken(InputBuffer* input, int* value);
+int runBatch(const char* path, bool perGame);
+bool openRecordWriter(RecordWriter* writer, const char* path);
+bool recordMove(RecordWriter* writer, Position pos);
+bool endRecord(RecordWriter* writer);
+bool closeRecordWriter(RecordWriter* writer);
+bool openRecordReader(RecordReader* reader, const char* path);
+int readRecordAt(RecordReader* reader, size_t offset, GameRecord* record);
+int nextRecord(RecordReader* reader, GameRecord* record);
+void closeRecordReader(RecordReader* reader);
+Position recordedMove(GameRecord* record, int index);
+bool recordStateAt(GameRecord* record, int moveIndex, GameState* game);
+int runEncodeRecords(const char* textPath, const char* recordPath);
+int runReplayRecords(const char* path);
+int validateRecord(GameRecord* record, int* move);
+int runValidateRecords(const char* path, int threadCount);
+bool initializeSharedTable(SharedTable* table, size_t megabytes);
+void freeSharedTable(SharedTable* table);
+uint64_t packTableData(int value, int depth, int bound, int move, uint8_t generation);
+bool probeSharedTable(SharedTable* table, uint64_t key, uint64_t* data);
+void storeSharedTable(SharedTable* table, uint64_t key, uint64_t data);
+void initializeSearch(SearchEngine* engine, Outcome seat, SharedTable* table);
+int evaluatePosition(GameState* game, Outcome seat);
+int searchPosition(SearchEngine* engine, GameState* game, int depth, int alpha, int beta, int ply);
+void* runSearchHelper(void* arg);
+bool searchBestMove(SearchEngine* engine, GameState* game, int maxDepth, double seconds, int threads, Position* move);
+int runSearchBenchmark(int games, double seconds, int threads, size_t tableMegabytes);
+bool initializeMcts(MctsPlayer* player, size_t megabytes, uint64_t seed);
+void freeMcts(MctsPlayer* player);
+uint32_t allocateMctsNodes(MctsPlayer* player, int count);
+void runMctsPlayout(MctsPlayer* player, GameState* root);
+void growMctsTree(MctsPlayer* player, GameState* game, uint64_t playouts, double seconds);
+void* runMctsWorker(void* arg);
+bool mctsBestMove(MctsPlayer* players, int threads, GameState* game, uint64_t playouts, double seconds, Position* move);
+int runMctsBenchmark(int games, uint64_t playouts, double seconds, int threads);
+int runMctsScaling(int positions, uint64_t playouts, int maxThreads, const char* tablebasePath);
+int heuristicMoveCell(GameState* game, Rng* rng);
+void* runSimulationWorker(void* arg);
+int runSimulation(uint64_t games, int threadCount, uint64_t seed, bool heuristic, int maxPlies, int boards, int size);
+bool parsePosition(const char* text, GameState* game);
+uint64_t packPerftData(uint64_t count, int depth, uint8_t generation);
+uint64_t perft(GameState* game, int depth, SharedTable* table);
+void* runPerftWorker(void* arg);
+int runPerft(int depth, int threadCount, size_t tableMegabytes, const char* position, int size);
+void initializeBoardKernels();
+const BoardKernel* boardKernel(int size);
+void* runBoardPerftWorker(void* arg);
+int runBoardPerft(int depth, int threadCount, const BoardKernel* kernel);
+void appendFrame(FrameBuffer* frame, const char* format, ...);
+void renderGame(FrameBuffer* frame, GameState* game);
+void renderGameStatus(FrameBuffer* frame, GameState* game);
+int visibleWidth(const char* text, size_t length);
+void eraseColumns(FrameBuffer* frame, int columns);
+void initializeBoardView(BoardView* view, int row, int column);
+void renderBoardChanges(FrameBuffer* frame, BoardView* view, GameState* game, const char* status);
+void writeFrame(FrameBuffer* frame);
+uint64_t packMonitorState(GameState* game);
+void unpackMonitorState(uint64_t state, GameState* game);
+int monitorLayout(int* perRow);
+void renderMonitor(FrameBuffer* frame, SimulationMonitor* monitor, BoardView* views, uint64_t* shown, uint64_t games);
+void watchSimulation(SimulationMonitor* monitor, uint64_t games);
+int runRenderBenchmark(int frames);
 void displayGame(GameState game);
 void clearScreen();
 
 // Winning patterns (W = C - T)
-const Position winningPatterns[3][4] = {
+const Position winningPatterns[NUM_PATTERNS][PATTERN_LENGTH] = {
     {{1,1}, {1,2}, {1,3}, {1,4}},  // Top row
     {{1,4}, {2,3}, {3,2}, {4,1}},  // Anti-diagonal
     {{4,1}, {4,2}, {4,3}, {4,4}}   // Right column
 };
 
+// Winning patterns as occupancy masks, built from winningPatterns at startup
+SetMask winningMasks[NUM_PATTERNS];
+
+// Draw rule applied by checkGameOver; off unless set from the command line or a tool
+DrawRule drawRule = {0, 0};
+
+// Bit p is set if the cell belongs to winning pattern p, built alongside winningMasks
+uint8_t cellPatterns[MAX_POSITIONS];
+
+// Zobrist keys per set and cell, and for turn and go being true. F's row stays
+// zero since the free cells follow from Uno's and Tres's.
+uint64_t zobristCells[3][MAX_POSITIONS];
+uint64_t zobristTurn;
+uint64_t zobristGo;
+
 /**
  * Initializes the game with values.
  * @param game - Pointer to the game state structure to be initialized.
@@ -58,16 +566,18 @@ const Position winningPatterns[3][4] = {
 void initializeGame(GameState* game)
 {
     // Clear sets
-    game->Uno.size = 0;
-    game->Tres.size = 0;
+    memset(&game->Uno, 0, sizeof(game->Uno));
+    memset(&game->Tres, 0, sizeof(game->Tres));
+    memset(&game->F, 0, sizeof(game->F));
+    game->Uno.owner = SET_UNO;
+    game->Tres.owner = SET_TRES;
+    game->F.owner = SET_FREE;
     
     // Initialize free positions (all positions are free initially)
-    game->F.size = 0;
     for (int x = 1; x <= GRID_SIZE; x++) {
         for (int y = 1; y <= GRID_SIZE; y++) {
-            game->F.positions[game->F.size].x = x;
-            game->F.positions[game->F.size].y = y;
-            game->F.size++;
+            Position pos = {x, y};
+            addPositionToSet(pos, &game->F);
         }
     }
     
@@ -75,8 +585,186 @@ void initializeGame(GameState* game)
     game->turn = true;
     game->go = false;
     game->over = false;
+    game->turnKey = zobristTurn;
+    game->moveCount = 0;
+    game->history = NULL;
+}
+
+/**
+ * Fills the Zobrist key tables.
+ * @return void
+ * @details Must run once at startup, before any game is initialized. The keys
+ *          come from a fixed splitmix64 sequence, so hashes are the same in
+ *          every run and every process.
+ */
+void initializeZobristKeys()
+{
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint64_t* keys[2 * MAX_POSITIONS + 2];
+    int count = 0;
+    
+    for (int cell = 0; cell < MAX_POSITIONS; cell++) {
+        keys[count++] = &zobristCells[SET_UNO][cell];
+        keys[count++] = &zobristCells[SET_TRES][cell];
+    }
+    keys[count++] = &zobristTurn;
+    keys[count++] = &zobristGo;
+    
+    for (int i = 0; i < count; i++) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        *keys[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * Returns the 64-bit Zobrist hash of a position.
+ * @param game - Pointer to the game state.
+ * @return uint64_t - Hash of Uno's and Tres's cells and of turn and go.
+ * @details The parts are kept up to date by addPositionToSet, removePositionFromSet
+ *          and the turn/go toggles in nextPlayerMove, so this costs three XORs.
+ */
+uint64_t positionKey(GameState* game)
+{
+    return game->Uno.key ^ game->Tres.key ^ game->F.key ^ game->turnKey;
+}
+
+/**
+ * Converts a grid position to its cell index.
+ * @param pos - The position to convert.
+ * @return int - The cell index (x-1)*GRID_SIZE + (y-1), or -1 if the position is off the grid.
+ * @details Cells are numbered in the same order initializeGame fills the free set,
+ *          so the cell index doubles as the bit number in a SetMask.
+ */
+int positionToCell(Position pos)
+{
+    if (pos.x < 1 || pos.x > GRID_SIZE || pos.y < 1 || pos.y > GRID_SIZE) {
+        return -1;
+    }
+    return (pos.x - 1) * GRID_SIZE + (pos.y - 1);
+}
+
+/**
+ * Converts a cell index back to its grid position.
+ * @param cell - The cell index, 0 to MAX_POSITIONS - 1.
+ * @return Position - The matching grid position.
+ */
+Position cellToPosition(int cell)
+{
+    Position pos = {cell / GRID_SIZE + 1, cell % GRID_SIZE + 1};
+    return pos;
+}
+
+/**
+ * Updates a set's per-pattern counters and Zobrist key after one of its cells changed.
+ * @param set - Pointer to the set that gained or lost the cell.
+ * @param cell - The cell that was added or removed.
+ * @param delta - +1 when the cell was added, -1 when it was removed.
+ * @return void
+ * @details Only the patterns containing the cell are touched, using the
+ *          cellPatterns incidence table, so win checks never rescan the board.
+ */
+void trackCellChange(PositionSet* set, int cell, int delta)
+{
+    set->key ^= zobristCells[set->owner][cell];
+    for (int patterns = cellPatterns[cell]; patterns; patterns &= patterns - 1) {
+        int p = __builtin_ctz(patterns);
+        if (delta < 0 && set->patternCounts[p] == PATTERN_LENGTH) {
+            set->completePatterns--;
+        }
+        set->patternCounts[p] += delta;
+        if (delta > 0 && set->patternCounts[p] == PATTERN_LENGTH) {
+            set->completePatterns++;
+        }
+    }
+}
+
+#ifndef ARRAY_POSITION_SETS
+
+/**
+ * Checks if a position exists within a given set.
+ * @param pos - The position to check for.
+ * @param set - The set to search in.
+ * @return bool - true if the position is found in the set, false otherwise.
+ * @details Tests the position's bit in the set's occupancy mask.
+ */
+bool positionInSet(Position pos, PositionSet set)
+{
+    int cell = positionToCell(pos);
+    return cell >= 0 && ((set.bits >> cell) & 1);
+}
+
+/**
+ * Adds a position to a set if it doesn't already exist in the set.
+ * @param pos - The position to add.
+ * @param set - Pointer to the set where the position should be added.
+ * @return void
+ * @details Sets the position's bit in the occupancy mask. Positions off the grid are ignored.
+ */
+void addPositionToSet(Position pos, PositionSet* set)
+{
+    int cell = positionToCell(pos);
+    if (cell >= 0 && !((set->bits >> cell) & 1)) {
+        set->bits |= (SetMask)(1u << cell);
+        trackCellChange(set, cell, 1);
+    }
+}
+
+/**
+ * Removes a position from a set.
+ * @param pos - The position to remove.
+ * @param set - Pointer to the set from which the position should be removed.
+ * @return void
+ * @details Clears the position's bit in the occupancy mask.
+ */
+void removePositionFromSet(Position pos, PositionSet* set)
+{
+    int cell = positionToCell(pos);
+    if (cell >= 0 && ((set->bits >> cell) & 1)) {
+        set->bits &= (SetMask)~(1u << cell);
+        trackCellChange(set, cell, -1);
+    }
+}
+
+/**
+ * Counts the positions in a set.
+ * @param set - The set to count.
+ * @return int - The number of positions in the set.
+ */
+int setSize(PositionSet set)
+{
+    return __builtin_popcount(set.bits);
+}
+
+/**
+ * Returns the occupancy mask of a set.
+ * @param set - The set to convert.
+ * @return SetMask - One bit per cell contained in the set.
+ */
+SetMask setToMask(PositionSet set)
+{
+    return set.bits;
+}
+
+/**
+ * Lists the positions of a set.
+ * @param set - The set to list.
+ * @param out - Array receiving the positions.
+ * @return int - The number of positions written.
+ * @details Positions are listed in cell order (x-major, then y).
+ */
+int setPositions(PositionSet set, Position out[MAX_POSITIONS])
+{
+    int count = 0;
+    for (SetMask bits = set.bits; bits; bits &= bits - 1) {
+        out[count++] = cellToPosition(__builtin_ctz(bits));
+    }
+    return count;
 }
 
+#else
+
 /**
  * Checks if a position exists within a given set.
  * @param pos - The position to check for.
@@ -107,6 +795,9 @@ void addPositionToSet(Position pos, PositionSet* set)
     if (!positionInSet(pos, *set)) {
         set->positions[set->size] = pos;
         set->size++;
+        if (positionToCell(pos) >= 0) {
+            trackCellChange(set, positionToCell(pos), 1);
+        }
     }
 }
 
@@ -125,35 +816,151 @@ void removePositionFromSet(Position pos, PositionSet* set)
             // Move the last position to this spot and decrease size
             set->positions[i] = set->positions[set->size - 1];
             set->size--;
+            if (positionToCell(pos) >= 0) {
+                trackCellChange(set, positionToCell(pos), -1);
+            }
             return;
         }
     }
 }
 
+/**
+ * Counts the positions in a set.
+ * @param set - The set to count.
+ * @return int - The number of positions in the set.
+ */
+int setSize(PositionSet set)
+{
+    return set.size;
+}
+
+/**
+ * Returns the occupancy mask of a set.
+ * @param set - The set to convert.
+ * @return SetMask - One bit per cell contained in the set.
+ */
+SetMask setToMask(PositionSet set)
+{
+    SetMask bits = 0;
+    for (int i = 0; i < set.size; i++) {
+        int cell = positionToCell(set.positions[i]);
+        if (cell >= 0) {
+            bits |= (SetMask)(1u << cell);
+        }
+    }
+    return bits;
+}
+
+/**
+ * Lists the positions of a set.
+ * @param set - The set to list.
+ * @param out - Array receiving the positions.
+ * @return int - The number of positions written.
+ * @details Positions are listed in the order they are stored in the set.
+ */
+int setPositions(PositionSet set, Position out[MAX_POSITIONS])
+{
+    memcpy(out, set.positions, set.size * sizeof(Position));
+    return set.size;
+}
+
+#endif
+
+/**
+ * Compiles the winning patterns into occupancy masks.
+ * @return void
+ * @details Must run once at startup, before any game is initialized. Each entry
+ *          of winningMasks has the bits of the four cells of the matching pattern,
+ *          and cellPatterns lists the patterns each cell belongs to.
+ */
+void initializeWinningMasks()
+{
+    memset(cellPatterns, 0, sizeof(cellPatterns));
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        winningMasks[p] = 0;
+        for (int i = 0; i < PATTERN_LENGTH; i++) {
+            int cell = positionToCell(winningPatterns[p][i]);
+            winningMasks[p] |= (SetMask)(1u << cell);
+            cellPatterns[cell] |= (uint8_t)(1u << p);
+        }
+    }
+}
+
+/**
+ * Checks if an occupancy mask covers any of the winning patterns.
+ * @param mask - The cells owned by a player.
+ * @return bool - true if every cell of some winning pattern is in the mask.
+ * @details Evaluates every pattern with an AND/compare and combines the results
+ *          without branching; the fixed trip count lets the compiler unroll it.
+ */
+bool maskHasWinningPattern(SetMask mask)
+{
+    int won = 0;
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        won |= (mask & winningMasks[p]) == winningMasks[p];
+    }
+    return won;
+}
+
 /**
  * Checks if a player's positions form any of the winning patterns.
  * @param playerSet - The set of positions owned by the player.
  * @return bool - true if the player has a winning pattern, false otherwise.
- * @details Iterates through predefined winning patterns and checks if all positions
- *          in any pattern are contained in the player's set.
+ * @details Reads the set's count of completed patterns, which addPositionToSet
+ *          and removePositionFromSet keep up to date.
  */
 bool checkWinningPattern(PositionSet playerSet)
 {
-    // For each winning pattern
-    for (int p = 0; p < 3; p++) {
-        bool patternComplete = true;
-        
-        // Check if all positions in the pattern are in the player's set
-        for (int i = 0; i < 4; i++) {
-            if (!positionInSet(winningPatterns[p][i], playerSet)) {
-                patternComplete = false;
-                break;
+    return playerSet.completePatterns > 0;
+}
+
+/**
+ * Starts recording a game's positions for repetition checks.
+ * @param game - Pointer to the game state.
+ * @param history - Storage for the keys; it must outlive the game's use of it.
+ * @return void
+ * @details Records the current position. checkGameOver then records every
+ *          position after a move, up to HISTORY_MAX_MOVES moves. Copies of
+ *          the game share the history, so searches clear the pointer in
+ *          their own copies.
+ */
+void trackHistory(GameState* game, PositionHistory* history)
+{
+    game->history = history;
+    if (game->moveCount <= HISTORY_MAX_MOVES) {
+        history->keys[game->moveCount] = positionKey(game);
+    }
+}
+
+/**
+ * Records the current position and applies the draw rule.
+ * @param game - Pointer to the current game state.
+ * @return bool - true if the game is drawn by the move cap or by repetition.
+ * @details Only positions a multiple of three moves back can repeat the
+ *          current one, since the key includes whose move it is. Under the
+ *          standard rules every round of three moves adds a piece, so no
+ *          position ever repeats; the repetition rule guards variants and
+ *          positions set up by hand.
+ */
+bool checkDrawRule(GameState* game)
+{
+    uint32_t count = game->moveCount;
+    if (game->history == NULL || count > HISTORY_MAX_MOVES) {
+        return drawRule.maxMoves > 0 && count >= (uint32_t)drawRule.maxMoves;
+    }
+    
+    uint64_t key = positionKey(game);
+    game->history->keys[count] = key;
+    if (drawRule.maxMoves > 0 && count >= (uint32_t)drawRule.maxMoves) {
+        return true;
+    }
+    if (drawRule.repetitions > 1) {
+        int seen = 1;
+        for (int i = (int)count - 3; i >= 0; i -= 3) {
+            if (game->history->keys[i] == key && ++seen >= drawRule.repetitions) {
+                return true;
             }
         }
-        
-        if (patternComplete) {
-            return true;
-        }
     }
     return false;
 }
@@ -164,6 +971,7 @@ bool checkWinningPattern(PositionSet playerSet)
  * @return void
  * @details Checks if either player has formed a winning pattern or if there are
  *          no free positions left, and sets the game's "over" flag accordingly.
+ *          Otherwise the game ends drawn, with no winner, if the draw rule says so.
  */
 void checkGameOver(GameState* game)
 {
@@ -174,7 +982,10 @@ void checkGameOver(GameState* game)
     else if (checkWinningPattern(game->Tres)){
         game->over = true;
     }
-    else if (game->F.size == 0) {
+    else if (setSize(game->F) == 0) {
+        game->over = true;
+    }
+    else if ((game->history != NULL || drawRule.maxMoves > 0) && checkDrawRule(game)) {
         game->over = true;
     }
 }
@@ -200,6 +1011,8 @@ bool nextPlayerMove(GameState* game, Position pos)
         // Toggle turn and go
         game->turn = !game->turn;
         game->go = !game->go;
+        game->turnKey ^= zobristTurn ^ zobristGo;
+        game->moveCount++;
         return true;
     }
     // Second case: Removal turn (turn=false)
@@ -222,6 +1035,8 @@ bool nextPlayerMove(GameState* game, Position pos)
             
             // Toggle turn
             game->turn = !game->turn;
+            game->turnKey ^= zobristTurn;
+            game->moveCount++;
             return true;
         }
     }
@@ -233,6 +1048,8 @@ bool nextPlayerMove(GameState* game, Position pos)
         removePositionFromSet(pos, &game->F);
         // Toggle go
         game->go = !game->go;
+        game->turnKey ^= zobristGo;
+        game->moveCount++;
         return true;
     }
     
@@ -241,148 +1058,4821 @@ bool nextPlayerMove(GameState* game, Position pos)
 }
 
 /**
- * Clears the console screen.
- * @return void
- * @details Uses platform-specific commands to clear the terminal/console screen
- *          (cls for Windows, clear for Unix-like systems).
+ * Plays a move in place, keeping what is needed to take it back.
+ * @param game - Pointer to the current game state.
+ * @param pos - The position being played.
+ * @param stack - Undo stack receiving the move.
+ * @return bool - false if the game is over, nextPlayerMove rejects the move or the stack is full.
+ * @details Works like playMove (nextPlayerMove, then checkGameOver) without
+ *          copying the state, so a search can walk the tree in one GameState.
  */
-void clrscr()
+bool applyMove(GameState* game, Position pos, UndoStack* stack)
 {
-    #ifdef _WIN32
-        system("cls");
-    #else
-        system("clear");
-    #endif
+    if (game->over || stack->size == UNDO_STACK_SIZE) {
+        return false;
+    }
+    
+    UndoEntry* entry = &stack->entries[stack->size];
+    entry->cell = (int8_t)positionToCell(pos);
+    entry->owner = game->turn ? SET_FREE : positionInSet(pos, game->Uno) ? SET_UNO : SET_TRES;
+    entry->turn = game->turn;
+    entry->go = game->go;
+    entry->over = game->over;
+    if (!nextPlayerMove(game, pos)) {
+        return false;
+    }
+    checkGameOver(game);
+    stack->size++;
+    return true;
 }
 
 /**
- * Displays the current game state in the console.
- * @param game - The current game state to display.
- * @return void
- * @details Renders the game grid showing player positions, displays game status and
- *          whose turn it is, and lists available moves for the current player.
+ * Takes back the last move made with applyMove.
+ * @param game - Pointer to the game state the move was applied to.
+ * @param stack - Undo stack holding the move.
+ * @return bool - false if there is no move to take back.
  */
-void displayGame(GameState game)
+bool undoMove(GameState* game, UndoStack* stack)
 {
-    clrscr();
-    
-    printf("");
-    printf("      GAME GRID\n\n");
-    
-    // Display coordinate reference above the board
-    printf("    ");
-    for (int x = 1; x <= GRID_SIZE; x++) {
-        printf("%d   ", x);
+    if (stack->size == 0) {
+        return false;
     }
-    printf("\n");
     
-    // Display the board with simplified format
-    for (int y = 1; y <= GRID_SIZE; y++) {
-        printf("%d  ", y);  // Row coordinate
-        
-        for (int x = 1; x <= GRID_SIZE; x++) {
-            Position currentPos = {x, y};
-            if (positionInSet(currentPos, game.Uno)) {
-                printf("\033[1;95m[U]\033[0m ");
+    UndoEntry* entry = &stack->entries[--stack->size];
+    Position pos = cellToPosition(entry->cell);
+    if (entry->owner == SET_FREE) {
+        // A placement: the piece goes back to free positions
+        removePositionFromSet(pos, entry->turn && entry->go ? &game->Uno : &game->Tres);
+        addPositionToSet(pos, &game->F);
+    } else {
+        // A removal: the piece goes back to its owner
+        removePositionFromSet(pos, &game->F);
+        addPositionToSet(pos, entry->owner == SET_UNO ? &game->Uno : &game->Tres);
+    }
+    game->turn = entry->turn;
+    game->go = entry->go;
+    game->over = entry->over;
+    game->turnKey = (game->turn ? zobristTurn : 0) ^ (game->go ? zobristGo : 0);
+    game->moveCount--;
+    return true;
+}
+
+/**
+ * Determines whose move it is.
+ * @param game - Pointer to the current game state.
+ * @return Phase - PHASE_UNO, PHASE_TRES or PHASE_DOS.
+ * @details Mirrors the three cases of nextPlayerMove.
+ */
+Phase gamePhase(GameState* game)
+{
+    if (!game->turn) {
+        return PHASE_DOS;
+    }
+    return game->go ? PHASE_UNO : PHASE_TRES;
+}
+
+/**
+ * Sets up a game state from occupancy masks.
+ * @param game - Receives the game state, including its over flag.
+ * @param uno - Cells owned by Uno.
+ * @param tres - Cells owned by Tres (disjoint from uno).
+ * @param phase - The player to move.
+ * @return void
+ * @details Goes through the set functions, so counters and keys are consistent.
+ *          moveCount is left at 0, since the masks do not tell how many moves
+ *          led to them; callers that know it must set it themselves.
+ */
+void setGamePosition(GameState* game, SetMask uno, SetMask tres, Phase phase)
+{
+    initializeGame(game);
+    for (int cell = 0; cell < MAX_POSITIONS; cell++) {
+        Position pos = cellToPosition(cell);
+        if ((uno >> cell) & 1) {
+            addPositionToSet(pos, &game->Uno);
+            removePositionFromSet(pos, &game->F);
+        } else if ((tres >> cell) & 1) {
+            addPositionToSet(pos, &game->Tres);
+            removePositionFromSet(pos, &game->F);
+        }
+    }
+    
+    game->turn = phase != PHASE_DOS;
+    game->go = phase == PHASE_UNO;
+    game->turnKey = (game->turn ? zobristTurn : 0) ^ (game->go ? zobristGo : 0);
+    checkGameOver(game);
+}
+
+/**
+ * Names the player who moves in a phase.
+ * @param phase - The phase.
+ * @return Outcome - OUTCOME_UNO, OUTCOME_TRES or OUTCOME_DOS.
+ */
+Outcome phasePlayer(Phase phase)
+{
+    return phase == PHASE_UNO ? OUTCOME_UNO : phase == PHASE_TRES ? OUTCOME_TRES : OUTCOME_DOS;
+}
+
+/**
+ * Applies the game over rules to a pair of occupancy masks.
+ * @param uno - Cells owned by Uno.
+ * @param tres - Cells owned by Tres.
+ * @return Outcome - The winner, or OUTCOME_NONE if the game is not over.
+ * @details Same order as checkGameOver: Uno's pattern, then Tres's pattern,
+ *          then Dos wins once no free positions remain.
+ */
+Outcome maskOutcome(SetMask uno, SetMask tres)
+{
+    if (maskHasWinningPattern(uno)) {
+        return OUTCOME_UNO;
+    }
+    if (maskHasWinningPattern(tres)) {
+        return OUTCOME_TRES;
+    }
+    if ((SetMask)(uno | tres) == FULL_MASK) {
+        return OUTCOME_DOS;
+    }
+    return OUTCOME_NONE;
+}
+
+/**
+ * Determines who has won the game.
+ * @param game - Pointer to the current game state.
+ * @return Outcome - The winner, or OUTCOME_NONE if the game is not over.
+ */
+Outcome gameWinner(GameState* game)
+{
+    return maskOutcome(setToMask(game->Uno), setToMask(game->Tres));
+}
+
+/**
+ * Lists the moves nextPlayerMove accepts in the current state.
+ * @param game - Pointer to the current game state.
+ * @param out - Array receiving the legal positions.
+ * @return int - The number of legal moves (0 once the game is over).
+ * @details Dos may remove any Uno or Tres piece; Uno and Tres may place on any
+ *          free position. Positions are listed in cell order.
+ */
+int legalMoves(GameState* game, Position out[MAX_POSITIONS])
+{
+    if (game->over) {
+        return 0;
+    }
+    
+    SetMask moves = game->turn ? setToMask(game->F)
+                               : (SetMask)(setToMask(game->Uno) | setToMask(game->Tres));
+    int count = 0;
+    for (; moves; moves &= moves - 1) {
+        out[count++] = cellToPosition(__builtin_ctz(moves));
+    }
+    return count;
+}
+
+/**
+ * Applies a move the way the game loop in main does.
+ * @param game - Pointer to the current game state.
+ * @param pos - The position being played.
+ * @return bool - false if the game is already over or nextPlayerMove rejects the move.
+ * @details Runs checkGameOver after every accepted move.
+ */
+bool playMove(GameState* game, Position pos)
+{
+    if (game->over || !nextPlayerMove(game, pos)) {
+        return false;
+    }
+    checkGameOver(game);
+    return true;
+}
+
+/**
+ * Reads a monotonic wall clock.
+ * @return double - Seconds since an arbitrary starting point.
+ */
+double wallSeconds()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Counts the processors available to worker threads.
+ * @return int - The number of online processors, at least 1.
+ */
+int cpuCount()
+{
+#ifdef _WIN32
+    const char* env = getenv("NUMBER_OF_PROCESSORS");
+    int count = env ? atoi(env) : 1;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+/**
+ * Seeds a random number generator.
+ * @param rng - The generator.
+ * @param seed - Any value; equal seeds give equal sequences.
+ * @return void
+ * @details The four state words come from splitmix64, which never yields an
+ *          all-zero state.
+ */
+void seedRandom(Rng* rng, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        rng->s[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * Draws the next value of a xoshiro256** generator.
+ * @param rng - The generator.
+ * @return uint64_t - A uniformly distributed 64-bit value.
+ */
+uint64_t nextRandom(Rng* rng)
+{
+    uint64_t* s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+/**
+ * Draws a random integer below a bound.
+ * @param rng - The generator.
+ * @param bound - Exclusive upper limit, at least 1.
+ * @return uint32_t - A value in [0, bound).
+ * @details Scales the top 32 bits instead of taking a remainder; the bias is
+ *          below 2^-27 for the bounds used here.
+ */
+uint32_t randomBelow(Rng* rng, uint32_t bound)
+{
+    return (uint32_t)(((nextRandom(rng) >> 32) * bound) >> 32);
+}
+
+/**
+ * Picks a uniformly random legal move.
+ * @param game - Pointer to the current game state.
+ * @param rng - The generator.
+ * @return int - The cell of the move, or -1 if there is none.
+ */
+int randomMoveCell(GameState* game, Rng* rng)
+{
+    if (game->over) {
+        return -1;
+    }
+    
+    SetMask moves = game->turn ? setToMask(game->F)
+                               : (SetMask)(setToMask(game->Uno) | setToMask(game->Tres));
+    if (moves == 0) {
+        return -1;
+    }
+    for (uint32_t skip = randomBelow(rng, __builtin_popcount(moves)); skip > 0; skip--) {
+        moves &= moves - 1;
+    }
+    return __builtin_ctz(moves);
+}
+
+/**
+ * Finishes a game with uniformly random moves.
+ * @param game - Pointer to the game, which is played out in place.
+ * @param rng - The generator.
+ * @param maxPlies - Number of moves after which the game is abandoned.
+ * @return Outcome - The winner, or OUTCOME_NONE if the game was abandoned.
+ */
+Outcome playRandomGame(GameState* game, Rng* rng, int maxPlies)
+{
+    for (int ply = 0; ply < maxPlies && !game->over; ply++) {
+        playMove(game, cellToPosition(randomMoveCell(game, rng)));
+    }
+    return game->over ? gameWinner(game) : OUTCOME_NONE;
+}
+
+/* ------------------------------------------------------------------------
+ * Retrograde solver
+ *
+ * Every state is indexed as phase * 3^16 plus the base-3 number whose digit
+ * for each cell is 0 (free), 1 (Uno) or 2 (Tres). That is only about 130
+ * million states, while a forward search would reach most of them again and
+ * again through different move orders, so the solver instead works backwards
+ * from the terminal states and settles each state once. It runs one pass per
+ * player: a state is a win for that player if the player is to move and some
+ * move reaches a won state, or another player is to move and every move does
+ * (the other two are assumed to play together against the player). At most
+ * one player can force a win from a given state; states nobody can force are
+ * left as OUTCOME_NONE, meaning none of the players can win against the other
+ * two.
+ *
+ * Each sweep is split across threads by ranges of 64-state bitset words.
+ * Seeding only touches the thread's own range; walking back from the frontier
+ * can reach any state, so counters, outcomes and the next frontier are then
+ * updated with atomic operations and no locks.
+ * ------------------------------------------------------------------------ */
+
+#if MAX_POSITIONS != 16
+#error "State indexing assumes a 4x4 grid"
+#endif
+
+#define HALF_CELLS 8
+#define HALF_STATES 6561                            // 3^HALF_CELLS
+#define BOARD_STATES (HALF_STATES * HALF_STATES)    // 3^MAX_POSITIONS
+#define STATE_COUNT ((uint32_t)NUM_PHASES * BOARD_STATES)
+#define BITSET_WORDS ((STATE_COUNT + 63) / 64)
+
+// Base-3 value of each 8-cell occupancy byte, and the reverse mapping
+uint16_t ternaryOfBits[1 << HALF_CELLS];
+uint16_t bitsOfTernary[HALF_STATES];    // Uno bits in the low byte, Tres bits in the high byte
+
+/**
+ * Builds the lookup tables used to convert between states and indices.
+ * @return void
+ */
+void initializeStateIndex()
+{
+    for (int bits = 0; bits < (1 << HALF_CELLS); bits++) {
+        int value = 0;
+        for (int i = HALF_CELLS - 1; i >= 0; i--) {
+            value = value * 3 + ((bits >> i) & 1);
+        }
+        ternaryOfBits[bits] = (uint16_t)value;
+    }
+    for (int value = 0; value < HALF_STATES; value++) {
+        int uno = 0, tres = 0, rest = value;
+        for (int i = 0; i < HALF_CELLS; i++) {
+            if (rest % 3 == 1) {
+                uno |= 1 << i;
+            } else if (rest % 3 == 2) {
+                tres |= 1 << i;
+            }
+            rest /= 3;
+        }
+        bitsOfTernary[value] = (uint16_t)(uno | (tres << 8));
+    }
+}
+
+/**
+ * Computes the index of a state.
+ * @param uno - Cells owned by Uno.
+ * @param tres - Cells owned by Tres (disjoint from uno).
+ * @param phase - The player to move.
+ * @return uint32_t - Index in the range [0, STATE_COUNT).
+ */
+uint32_t stateIndex(SetMask uno, SetMask tres, Phase phase)
+{
+    uint32_t low = ternaryOfBits[uno & 0xFF] + 2u * ternaryOfBits[tres & 0xFF];
+    uint32_t high = ternaryOfBits[uno >> 8] + 2u * ternaryOfBits[tres >> 8];
+    return (uint32_t)phase * BOARD_STATES + high * HALF_STATES + low;
+}
+
+/**
+ * Recovers the state with a given index.
+ * @param index - Index previously produced by stateIndex.
+ * @param uno - Receives the cells owned by Uno.
+ * @param tres - Receives the cells owned by Tres.
+ * @param phase - Receives the player to move.
+ * @return void
+ */
+void indexToState(uint32_t index, SetMask* uno, SetMask* tres, Phase* phase)
+{
+    uint32_t board = index % BOARD_STATES;
+    uint16_t low = bitsOfTernary[board % HALF_STATES];
+    uint16_t high = bitsOfTernary[board / HALF_STATES];
+    
+    *uno = (SetMask)((low & 0xFF) | ((high & 0xFF) << 8));
+    *tres = (SetMask)((low >> 8) | (high & 0xFF00));
+    *phase = (Phase)(index / BOARD_STATES);
+}
+
+/**
+ * Computes the index of a game state.
+ * @param game - Pointer to the game state.
+ * @return uint32_t - The state's index.
+ */
+uint32_t gameStateIndex(GameState* game)
+{
+    return stateIndex(setToMask(game->Uno), setToMask(game->Tres), gamePhase(game));
+}
+
+/* ------------------------------------------------------------------------
+ * Dense state ranking
+ *
+ * The turn/go sequence ties the piece counts to the phase: Tres moves with at
+ * most 14 pieces on the board, Uno moves right after Tres placed (Tres has a
+ * piece), and Dos moves right after both placed. Ranks number exactly the
+ * states that meet these rules, grouped by phase and by Uno/Tres piece
+ * counts; within a group, Uno's cells and then Tres's cells (counted among
+ * the cells Uno does not hold) are ranked with the combinatorial number system.
+ * ------------------------------------------------------------------------ */
+
+uint32_t binomial[MAX_POSITIONS + 1][MAX_POSITIONS + 1];
+uint32_t rankBlockStart[NUM_PHASES * (MAX_POSITIONS + 1) * (MAX_POSITIONS + 1) + 1];
+uint32_t rankedStateCount;
+
+/**
+ * Checks the piece counts of a state against the turn/go sequence.
+ * @param uno - Cells owned by Uno.
+ * @param tres - Cells owned by Tres.
+ * @param phase - The player to move.
+ * @return bool - true if the state has a rank.
+ */
+bool stateIsRankable(SetMask uno, SetMask tres, Phase phase)
+{
+    int u = __builtin_popcount(uno), t = __builtin_popcount(tres);
+    if ((uno & tres) != 0) {
+        return false;
+    }
+    if (phase == PHASE_TRES) {
+        return u + t <= MAX_POSITIONS - 2;
+    }
+    if (phase == PHASE_UNO) {
+        return t >= 1 && u + t <= MAX_POSITIONS - 1;
+    }
+    return u >= 1 && t >= 1;
+}
+
+/**
+ * Builds the binomial table and the first rank of every phase/piece-count group.
+ * @return void
+ */
+void initializeStateRanking()
+{
+    for (int n = 0; n <= MAX_POSITIONS; n++) {
+        for (int k = 0; k <= MAX_POSITIONS; k++) {
+            binomial[n][k] = k == 0 ? 1 : n == 0 ? 0 : binomial[n - 1][k - 1] + binomial[n - 1][k];
+        }
+    }
+    
+    uint32_t next = 0;
+    int block = 0;
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        for (int u = 0; u <= MAX_POSITIONS; u++) {
+            for (int t = 0; t <= MAX_POSITIONS; t++) {
+                rankBlockStart[block++] = next;
+                // Any board with these counts tells whether the group is allowed
+                SetMask uno = (SetMask)((1u << u) - 1);
+                SetMask tres = (SetMask)(((1u << t) - 1) << u);
+                if (u + t <= MAX_POSITIONS && stateIsRankable(uno, tres, (Phase)phase)) {
+                    next += binomial[MAX_POSITIONS][u] * binomial[MAX_POSITIONS - u][t];
+                }
+            }
+        }
+    }
+    rankBlockStart[block] = next;
+    rankedStateCount = next;
+}
+
+/**
+ * Computes the dense rank of a state.
+ * @param uno - Cells owned by Uno.
+ * @param tres - Cells owned by Tres.
+ * @param phase - The player to move.
+ * @return uint32_t - Rank in the range [0, rankedStateCount).
+ * @details The state must satisfy stateIsRankable.
+ */
+uint32_t rankState(SetMask uno, SetMask tres, Phase phase)
+{
+    uint32_t unoRank = 0, tresRank = 0;
+    int u = 0, t = 0, open = 0;
+    
+    for (int cell = 0; cell < MAX_POSITIONS; cell++) {
+        if ((uno >> cell) & 1) {
+            unoRank += binomial[cell][++u];
+        } else {
+            if ((tres >> cell) & 1) {
+                tresRank += binomial[open][++t];
+            }
+            open++;
+        }
+    }
+    
+    int block = (phase * (MAX_POSITIONS + 1) + u) * (MAX_POSITIONS + 1) + t;
+    return rankBlockStart[block] + unoRank * binomial[MAX_POSITIONS - u][t] + tresRank;
+}
+
+/**
+ * Decodes a subset from its combinatorial number system rank.
+ * @param rank - The subset's rank.
+ * @param size - Number of elements in the subset.
+ * @return uint32_t - Bit i is set if element i is in the subset.
+ */
+uint32_t unrankSubset(uint32_t rank, int size)
+{
+    uint32_t bits = 0;
+    int element = MAX_POSITIONS - 1;
+    
+    for (int k = size; k >= 1; k--) {
+        while (binomial[element][k] > rank) {
+            element--;
+        }
+        rank -= binomial[element][k];
+        bits |= 1u << element;
+        element--;
+    }
+    return bits;
+}
+
+/**
+ * Recovers the state with a given dense rank.
+ * @param rank - Rank previously produced by rankState.
+ * @param uno - Receives the cells owned by Uno.
+ * @param tres - Receives the cells owned by Tres.
+ * @param phase - Receives the player to move.
+ * @return void
+ */
+void unrankState(uint32_t rank, SetMask* uno, SetMask* tres, Phase* phase)
+{
+    // Find the last group starting at or before the rank
+    int low = 0, high = NUM_PHASES * (MAX_POSITIONS + 1) * (MAX_POSITIONS + 1);
+    while (high - low > 1) {
+        int middle = (low + high) / 2;
+        if (rankBlockStart[middle] <= rank) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    
+    int t = low % (MAX_POSITIONS + 1);
+    int u = low / (MAX_POSITIONS + 1) % (MAX_POSITIONS + 1);
+    uint32_t local = rank - rankBlockStart[low];
+    uint32_t tresWidth = binomial[MAX_POSITIONS - u][t];
+    
+    *uno = (SetMask)unrankSubset(local / tresWidth, u);
+    *phase = (Phase)(low / ((MAX_POSITIONS + 1) * (MAX_POSITIONS + 1)));
+    
+    // Spread Tres's cells over the cells Uno does not hold
+    uint32_t openBits = unrankSubset(local % tresWidth, t);
+    *tres = 0;
+    for (int cell = 0, open = 0; cell < MAX_POSITIONS; cell++) {
+        if (!((*uno >> cell) & 1)) {
+            if ((openBits >> open) & 1) {
+                *tres |= (SetMask)(1u << cell);
+            }
+            open++;
+        }
+    }
+}
+
+/**
+ * Computes the dense rank of a game state.
+ * @param game - Pointer to a game state reached through nextPlayerMove.
+ * @return uint32_t - The state's rank.
+ */
+uint32_t rankGameState(GameState* game)
+{
+    return rankState(setToMask(game->Uno), setToMask(game->Tres), gamePhase(game));
+}
+
+/**
+ * Rebuilds the game state with a given dense rank.
+ * @param rank - Rank previously produced by rankState.
+ * @param game - Receives the game state, including its over flag.
+ * @return void
+ */
+void unrankGameState(uint32_t rank, GameState* game)
+{
+    SetMask uno, tres;
+    Phase phase;
+    unrankState(rank, &uno, &tres, &phase);
+    setGamePosition(game, uno, tres, phase);
+}
+
+/**
+ * Checks that ranking and unranking are inverse to each other.
+ * @param games - Number of random games whose positions are also round-tripped.
+ * @return int - Process exit code.
+ * @details Every rank below rankedStateCount must unrank to a rankable state
+ *          that ranks back to it, and there must be exactly that many rankable
+ *          states, so the ranks cover each of them once. Random games then
+ *          check rankGameState and unrankGameState on positions reached in play.
+ */
+int runSelfTest(int games)
+{
+    uint32_t rankable = 0, failures = 0;
+    double start = wallSeconds();
+    
+    initializeStateRanking();
+    for (uint32_t index = 0; index < STATE_COUNT; index++) {
+        SetMask uno, tres;
+        Phase phase;
+        indexToState(index, &uno, &tres, &phase);
+        rankable += stateIsRankable(uno, tres, phase);
+    }
+    failures += rankable != rankedStateCount;
+    
+    for (uint32_t rank = 0; rank < rankedStateCount; rank++) {
+        SetMask uno, tres;
+        Phase phase;
+        unrankState(rank, &uno, &tres, &phase);
+        failures += !stateIsRankable(uno, tres, phase) || rankState(uno, tres, phase) != rank;
+    }
+    printf("State ranks: %u of %u states, %u failure(s)\n", rankedStateCount, STATE_COUNT, failures);
+    
+    uint32_t positions = 0, gameFailures = 0;
+    Rng rng;
+    seedRandom(&rng, 1);
+    for (int g = 0; g < games; g++) {
+        GameState game;
+        initializeGame(&game);
+        while (true) {
+            GameState rebuilt;
+            initializeGame(&rebuilt);
+            unrankGameState(rankGameState(&game), &rebuilt);
+            gameFailures += setToMask(rebuilt.Uno) != setToMask(game.Uno)
+                         || setToMask(rebuilt.Tres) != setToMask(game.Tres)
+                         || gamePhase(&rebuilt) != gamePhase(&game) || rebuilt.over != game.over;
+            positions++;
+            if (game.over) {
+                break;
+            }
+            playMove(&game, cellToPosition(randomMoveCell(&game, &rng)));
+        }
+    }
+    printf("Game positions: %u from %d game(s), %u failure(s)\n", positions, games, gameFailures);
+    printf("Finished in %.2f s\n", wallSeconds() - start);
+    return failures + gameFailures == 0 ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Symmetry canonicalization
+ *
+ * The rules only look at which cells form the winning patterns, so any
+ * relabelling of cells that maps the patterns onto the patterns gives an
+ * equivalent position. Cells contained in exactly the same patterns (their
+ * "signature") can be swapped freely, and a permutation of the patterns is a
+ * symmetry when it maps every signature class onto a class of the same size.
+ * Together these generate the automorphism group of the configured table, and
+ * a state's canonical form only depends on how many Uno and Tres pieces sit in
+ * each class: pieces are packed into the lowest cells of their (permuted)
+ * class, Uno first, and the smallest result over the pattern permutations wins.
+ * ------------------------------------------------------------------------ */
+
+#define SIGNATURES (1 << NUM_PATTERNS)
+#define MAX_PATTERN_SYMMETRIES 720
+
+SetMask signatureCells[SIGNATURES];                      // Cells with each signature
+SetMask signatureFill[SIGNATURES][MAX_POSITIONS + 1];    // Lowest k cells of each class
+uint8_t patternSymmetries[MAX_PATTERN_SYMMETRIES][SIGNATURES];    // Image of each signature
+int patternSymmetryCount;
+
+/**
+ * Applies a permutation of the patterns to a signature.
+ * @param order - order[p] is the pattern that pattern p is mapped to.
+ * @param signature - Bit p set if the cell is in pattern p.
+ * @return int - The permuted signature.
+ */
+int permuteSignature(int order[NUM_PATTERNS], int signature)
+{
+    int image = 0;
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        if ((signature >> p) & 1) {
+            image |= 1 << order[p];
+        }
+    }
+    return image;
+}
+
+/**
+ * Records every pattern permutation from position depth on that keeps class sizes.
+ * @param order - Permutation being built.
+ * @param depth - Number of entries already fixed.
+ * @return void
+ */
+void collectPatternSymmetries(int order[NUM_PATTERNS], int depth)
+{
+    if (depth == NUM_PATTERNS) {
+        for (int sig = 0; sig < SIGNATURES; sig++) {
+            if (__builtin_popcount(signatureCells[sig])
+                != __builtin_popcount(signatureCells[permuteSignature(order, sig)])) {
+                return;
+            }
+        }
+        if (patternSymmetryCount < MAX_PATTERN_SYMMETRIES) {
+            for (int sig = 0; sig < SIGNATURES; sig++) {
+                patternSymmetries[patternSymmetryCount][sig] = (uint8_t)permuteSignature(order, sig);
+            }
+            patternSymmetryCount++;
+        }
+        return;
+    }
+    
+    for (int i = depth; i < NUM_PATTERNS; i++) {
+        int swap = order[depth]; order[depth] = order[i]; order[i] = swap;
+        collectPatternSymmetries(order, depth + 1);
+        swap = order[depth]; order[depth] = order[i]; order[i] = swap;
+    }
+}
+
+/**
+ * Derives the symmetry classes and pattern permutations from winningMasks.
+ * @return void
+ * @details Needs initializeWinningMasks to have run.
+ */
+void initializeSymmetries()
+{
+    memset(signatureCells, 0, sizeof(signatureCells));
+    for (int cell = 0; cell < MAX_POSITIONS; cell++) {
+        int signature = 0;
+        for (int p = 0; p < NUM_PATTERNS; p++) {
+            if ((winningMasks[p] >> cell) & 1) {
+                signature |= 1 << p;
+            }
+        }
+        signatureCells[signature] |= (SetMask)(1u << cell);
+    }
+    
+    for (int sig = 0; sig < SIGNATURES; sig++) {
+        SetMask fill = 0;
+        SetMask rest = signatureCells[sig];
+        signatureFill[sig][0] = 0;
+        for (int k = 1; k <= MAX_POSITIONS; k++) {
+            fill |= rest & -rest;
+            rest &= rest - 1;
+            signatureFill[sig][k] = fill;
+        }
+    }
+    
+    int order[NUM_PATTERNS];
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        order[p] = p;
+    }
+    patternSymmetryCount = 0;
+    collectPatternSymmetries(order, 0);
+}
+
+/**
+ * Maps a position to the canonical representative of its symmetry class.
+ * @param uno - Cells owned by Uno.
+ * @param tres - Cells owned by Tres.
+ * @param canonicalUno - Receives Uno's cells in the canonical position.
+ * @param canonicalTres - Receives Tres's cells in the canonical position.
+ * @return void
+ * @details Equivalent positions (same phase) have the same outcome under best
+ *          play, so tables keyed by position only need the canonical ones.
+ */
+void canonicalizeState(SetMask uno, SetMask tres, SetMask* canonicalUno, SetMask* canonicalTres)
+{
+    int unoCount[SIGNATURES], pieceCount[SIGNATURES];
+    uint32_t best = UINT32_MAX;
+    
+    for (int sig = 0; sig < SIGNATURES; sig++) {
+        unoCount[sig] = __builtin_popcount(uno & signatureCells[sig]);
+        pieceCount[sig] = unoCount[sig] + __builtin_popcount(tres & signatureCells[sig]);
+    }
+    
+    for (int s = 0; s < patternSymmetryCount; s++) {
+        SetMask mappedUno = 0, mappedTres = 0;
+        for (int sig = 0; sig < SIGNATURES; sig++) {
+            int image = patternSymmetries[s][sig];
+            mappedUno |= signatureFill[image][unoCount[sig]];
+            mappedTres |= signatureFill[image][pieceCount[sig]] & ~signatureFill[image][unoCount[sig]];
+        }
+        
+        uint32_t key = mappedUno | ((uint32_t)mappedTres << 16);
+        if (key < best) {
+            best = key;
+            *canonicalUno = mappedUno;
+            *canonicalTres = mappedTres;
+        }
+    }
+}
+
+/**
+ * Computes the index of the canonical representative of a game state.
+ * @param game - Pointer to the game state.
+ * @return uint32_t - The canonical state's index.
+ */
+uint32_t canonicalGameIndex(GameState* game)
+{
+    SetMask uno, tres;
+    canonicalizeState(setToMask(game->Uno), setToMask(game->Tres), &uno, &tres);
+    return stateIndex(uno, tres, gamePhase(game));
+}
+
+/**
+ * Prints the symmetry group of the configured patterns and how many states are canonical.
+ * @return int - Process exit code.
+ */
+int runSymmetryReport()
+{
+    double groupOrder = patternSymmetryCount;
+    
+    printf("Cell classes (cells sharing the same patterns):\n");
+    for (int sig = 0; sig < SIGNATURES; sig++) {
+        int size = __builtin_popcount(signatureCells[sig]);
+        if (size == 0) {
+            continue;
+        }
+        printf("  patterns {");
+        for (int p = 0; p < NUM_PATTERNS; p++) {
+            if ((sig >> p) & 1) {
+                printf(" %d", p + 1);
+            }
+        }
+        printf(" }: %d cell(s)\n", size);
+        for (int k = 2; k <= size; k++) {
+            groupOrder *= k;
+        }
+    }
+    printf("Pattern permutations: %d\n", patternSymmetryCount);
+    printf("Automorphism group order: %.0f\n", groupOrder);
+    
+    uint32_t canonical = 0;
+    for (uint32_t index = 0; index < BOARD_STATES; index++) {
+        SetMask uno, tres, canonicalUno, canonicalTres;
+        Phase phase;
+        indexToState(index, &uno, &tres, &phase);
+        canonicalizeState(uno, tres, &canonicalUno, &canonicalTres);
+        canonical += canonicalUno == uno && canonicalTres == tres;
+    }
+    printf("Canonical boards: %u of %u (%.2f%%)\n", canonical, BOARD_STATES,
+           100.0 * canonical / BOARD_STATES);
+    return 0;
+}
+
+/**
+ * Reads one outcome from an array of packed 2-bit outcomes.
+ * @param outcomes - Four outcomes per byte, lowest bits first.
+ * @param index - The state's index.
+ * @return Outcome - The stored outcome.
+ */
+Outcome unpackOutcome(uint8_t* outcomes, uint32_t index)
+{
+    return (Outcome)((outcomes[index >> 2] >> ((index & 3) * 2)) & 3);
+}
+
+/**
+ * Reads the solved outcome of a state.
+ * @param table - A solved table.
+ * @param index - The state's index.
+ * @return Outcome - The player who can force a win, or OUTCOME_NONE.
+ */
+Outcome probeOutcome(SolverTable* table, uint32_t index)
+{
+    return unpackOutcome(table->outcomes, index);
+}
+
+/**
+ * Marks a predecessor as having one fewer unresolved move.
+ * @param sweep - The sweep in progress.
+ * @param index - The predecessor's index.
+ * @return bool - true if the predecessor became a win for the player.
+ * @details A zero count means the state is terminal, already won, or has no moves.
+ *          The decrement is a compare-and-swap so exactly one thread sees the
+ *          count reach zero and labels the state. Distances fit in a byte: the
+ *          longest forced win on the 4x4 grid is 40 plies.
+ */
+bool solverReach(SolverSweep* sweep, uint32_t index)
+{
+    uint8_t* counter = &sweep->counts[index];
+    uint8_t outcomeBits = (uint8_t)(sweep->player << ((index & 3) * 2));
+    uint64_t frontierBit = 1ull << (index & 63);
+    
+    if (!sweep->shared) {
+        if (*counter == 0 || --*counter != 0) {
+            return false;
+        }
+        sweep->table->outcomes[index >> 2] |= outcomeBits;
+        sweep->table->distances[index] = (uint8_t)sweep->level;
+        sweep->next[index >> 6] |= frontierBit;
+        return true;
+    }
+    
+    uint8_t count = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    do {
+        if (count == 0) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(counter, &count, (uint8_t)(count - 1), true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    if (count != 1) {
+        return false;
+    }
+    
+    __atomic_fetch_or(&sweep->table->outcomes[index >> 2], outcomeBits, __ATOMIC_RELAXED);
+    sweep->table->distances[index] = (uint8_t)sweep->level;
+    __atomic_fetch_or(&sweep->next[index >> 6], frontierBit, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * Sets up the move counters and the terminal wins for one range of states.
+ * @param arg - Pointer to the thread's SolverSweep.
+ * @return void* - Always NULL.
+ * @details A state where the player moves needs one won successor (count 1);
+ *          a state where another player moves needs all of them (count = number
+ *          of moves). Terminal states get count 0 and, if the player won them,
+ *          join the frontier at distance 0.
+ */
+void* solverSeedRange(void* arg)
+{
+    SolverSweep* sweep = arg;
+    uint32_t first = sweep->firstWord * 64;
+    uint32_t last = sweep->lastWord * 64 < STATE_COUNT ? sweep->lastWord * 64 : STATE_COUNT;
+    
+    memset(&sweep->frontier[sweep->firstWord], 0,
+           (sweep->lastWord - sweep->firstWord) * sizeof(uint64_t));
+    for (uint32_t index = first; index < last; index++) {
+        SetMask uno, tres;
+        Phase phase;
+        indexToState(index, &uno, &tres, &phase);
+        
+        Outcome outcome = maskOutcome(uno, tres);
+        if (outcome != OUTCOME_NONE) {
+            sweep->counts[index] = 0;
+            if (outcome == sweep->player) {
+                sweep->table->outcomes[index >> 2] |= (uint8_t)(outcome << ((index & 3) * 2));
+                sweep->table->distances[index] = 0;
+                sweep->frontier[index >> 6] |= 1ull << (index & 63);
+                sweep->reached++;
+            }
+            continue;
+        }
+        
+        int moves = phase == PHASE_DOS ? __builtin_popcount(uno | tres)
+                                       : MAX_POSITIONS - __builtin_popcount(uno | tres);
+        sweep->counts[index] = (uint8_t)(phasePlayer(phase) == sweep->player && moves > 0 ? 1 : moves);
+    }
+    return NULL;
+}
+
+/**
+ * Walks back one ply from the frontier states in one range.
+ * @param arg - Pointer to the thread's SolverSweep.
+ * @return void* - Always NULL.
+ */
+void* solverExpandRange(void* arg)
+{
+    SolverSweep* sweep = arg;
+    
+    for (uint32_t word = sweep->firstWord; word < sweep->lastWord; word++) {
+        for (uint64_t bits = sweep->frontier[word]; bits; bits &= bits - 1) {
+            uint32_t index = word * 64 + __builtin_ctzll(bits);
+            SetMask uno, tres;
+            Phase phase;
+            indexToState(index, &uno, &tres, &phase);
+            
+            if (phase == PHASE_UNO) {
+                // Tres just placed one of its pieces
+                for (SetMask cells = tres; cells; cells &= cells - 1) {
+                    SetMask cell = cells & -cells;
+                    sweep->reached += solverReach(sweep, stateIndex(uno, tres ^ cell, PHASE_TRES));
+                }
+            } else if (phase == PHASE_DOS) {
+                // Uno just placed one of its pieces
+                for (SetMask cells = uno; cells; cells &= cells - 1) {
+                    SetMask cell = cells & -cells;
+                    sweep->reached += solverReach(sweep, stateIndex(uno ^ cell, tres, PHASE_UNO));
+                }
+            } else {
+                // Dos just removed a piece of either player
+                for (SetMask cells = FULL_MASK & ~(uno | tres); cells; cells &= cells - 1) {
+                    SetMask cell = cells & -cells;
+                    sweep->reached += solverReach(sweep, stateIndex(uno | cell, tres, PHASE_DOS));
+                    sweep->reached += solverReach(sweep, stateIndex(uno, tres | cell, PHASE_DOS));
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs one sweep split evenly across threads.
+ * @param sweep - Template for the sweep; its word range and count are filled per thread.
+ * @param threadCount - Number of threads to use.
+ * @param work - solverSeedRange or solverExpandRange.
+ * @return uint64_t - Total number of states won in the sweep.
+ * @details A range whose thread cannot be started is worked on by the calling
+ *          thread, so every range is covered either way.
+ */
+uint64_t runSolverSweep(SolverSweep* sweep, int threadCount, void* (*work)(void*))
+{
+    SolverSweep parts[threadCount];
+    pthread_t threads[threadCount];
+    bool running[threadCount];
+    uint64_t reached = 0;
+    
+    for (int t = 0; t < threadCount; t++) {
+        parts[t] = *sweep;
+        parts[t].firstWord = (uint32_t)((uint64_t)BITSET_WORDS * t / threadCount);
+        parts[t].lastWord = (uint32_t)((uint64_t)BITSET_WORDS * (t + 1) / threadCount);
+        parts[t].reached = 0;
+        running[t] = t > 0 && pthread_create(&threads[t], NULL, work, &parts[t]) == 0;
+        if (t > 0 && !running[t]) {
+            work(&parts[t]);
+        }
+    }
+    work(&parts[0]);
+    
+    for (int t = 0; t < threadCount; t++) {
+        if (running[t]) {
+            pthread_join(threads[t], NULL);
+        }
+        reached += parts[t].reached;
+    }
+    return reached;
+}
+
+/**
+ * Finds every state from which a player can force a win.
+ * @param table - The table being solved.
+ * @param player - The player to solve for.
+ * @param counts - Scratch array of STATE_COUNT move counters.
+ * @param frontier - Scratch bitset of BITSET_WORDS words.
+ * @param next - Scratch bitset of BITSET_WORDS words.
+ * @param threadCount - Number of threads to use.
+ * @return uint64_t - The number of states won by the player.
+ * @details Seeds the frontier with the terminal states the player has won, then
+ *          repeatedly walks back one ply until no new state is won.
+ */
+uint64_t solvePlayer(SolverTable* table, Outcome player, uint8_t* counts,
+                     uint64_t* frontier, uint64_t* next, int threadCount)
+{
+    SolverSweep sweep = {table, player, counts, frontier, next, 0, threadCount > 1, 0, 0, 0};
+    uint64_t won = runSolverSweep(&sweep, threadCount, solverSeedRange);
+    
+    for (sweep.level = 1; ; sweep.level++) {
+        memset(sweep.next, 0, BITSET_WORDS * sizeof(uint64_t));
+        uint64_t reached = runSolverSweep(&sweep, threadCount, solverExpandRange);
+        if (reached == 0) {
+            break;
+        }
+        won += reached;
+        
+        uint64_t* swap = sweep.frontier;
+        sweep.frontier = sweep.next;
+        sweep.next = swap;
+    }
+    return won;
+}
+
+/**
+ * Labels every state with the player who can force a win from it.
+ * @param table - Table to fill; its arrays are allocated here.
+ * @param threadCount - Number of threads to use.
+ * @return bool - true on success, false if memory could not be allocated.
+ * @details Needs initializeWinningMasks and initializeStateIndex to have run.
+ *          Uses about 320 MB while solving; the finished table keeps 2 bits of
+ *          outcome and one distance byte per state.
+ */
+bool solveGame(SolverTable* table, int threadCount)
+{
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    table->outcomes = calloc(STATE_COUNT / 4 + 1, 1);
+    table->distances = calloc(STATE_COUNT, 1);
+    uint8_t* counts = malloc(STATE_COUNT);
+    uint64_t* frontier = malloc(BITSET_WORDS * sizeof(uint64_t));
+    uint64_t* next = malloc(BITSET_WORDS * sizeof(uint64_t));
+    
+    bool ok = table->outcomes && table->distances && counts && frontier && next;
+    if (ok) {
+        solvePlayer(table, OUTCOME_UNO, counts, frontier, next, threadCount);
+        solvePlayer(table, OUTCOME_TRES, counts, frontier, next, threadCount);
+        solvePlayer(table, OUTCOME_DOS, counts, frontier, next, threadCount);
+    } else {
+        freeSolverTable(table);
+    }
+    
+    free(counts);
+    free(frontier);
+    free(next);
+    return ok;
+}
+
+/**
+ * Releases the arrays of a solver table.
+ * @param table - The table to release.
+ * @return void
+ */
+void freeSolverTable(SolverTable* table)
+{
+    free(table->outcomes);
+    free(table->distances);
+    table->outcomes = NULL;
+    table->distances = NULL;
+}
+
+/**
+ * Picks the best move for the player to move using a solved table.
+ * @param table - A solved table.
+ * @param game - Pointer to the current game state.
+ * @param move - Receives the chosen position.
+ * @return bool - false if there is no legal move.
+ * @details The mover takes the fastest win it can force; otherwise it keeps the
+ *          game undecided if possible, and failing that delays the loss the longest.
+ */
+bool solverBestMove(SolverTable* table, GameState* game, Position* move)
+{
+    Position moves[MAX_POSITIONS];
+    int count = legalMoves(game, moves);
+    Outcome mover = phasePlayer(gamePhase(game));
+    int bestScore = -1;
+    
+    for (int i = 0; i < count; i++) {
+        GameState next = *game;
+        nextPlayerMove(&next, moves[i]);
+        
+        uint32_t index = gameStateIndex(&next);
+        Outcome outcome = probeOutcome(table, index);
+        int distance = table->distances[index];
+        int score = outcome == mover ? 1000 - distance
+                  : outcome == OUTCOME_NONE ? 500 : distance;
+        
+        if (score > bestScore) {
+            bestScore = score;
+            *move = moves[i];
+        }
+    }
+    return count > 0;
+}
+
+/**
+ * Solves the whole game and prints a summary.
+ * @param threadCount - Number of solver threads.
+ * @return int - Process exit code.
+ */
+int runSolver(int threadCount)
+{
+    SolverTable table;
+    double start = wallSeconds();
+    
+    printf("Solving %u states with %d thread(s)...\n", STATE_COUNT, threadCount);
+    if (!solveGame(&table, threadCount)) {
+        fprintf(stderr, "Not enough memory to solve the game.\n");
+        return 1;
+    }
+    
+    uint64_t totals[4] = {0};
+    int deepest[4] = {0};
+    for (uint32_t index = 0; index < STATE_COUNT; index++) {
+        Outcome outcome = probeOutcome(&table, index);
+        totals[outcome]++;
+        if (outcome != OUTCOME_NONE && table.distances[index] > deepest[outcome]) {
+            deepest[outcome] = table.distances[index];
+        }
+    }
+    
+    const char* names[4] = {"No forced win", "Uno wins", "Tres wins", "Dos wins"};
+    for (int o = 1; o < 4; o++) {
+        printf("%-14s %10llu states, longest forced win %d plies\n",
+               names[o], (unsigned long long)totals[o], deepest[o]);
+    }
+    printf("%-14s %10llu states\n", names[0], (unsigned long long)totals[0]);
+    
+    initializeStateRanking();
+    printf("Dense ranking covers %u states (%.1f%% of the index)\n",
+           rankedStateCount, 100.0 * rankedStateCount / STATE_COUNT);
+    
+    GameState game;
+    initializeGame(&game);
+    uint32_t startIndex = gameStateIndex(&game);
+    printf("Initial position: %s", names[probeOutcome(&table, startIndex)]);
+    Position move;
+    if (solverBestMove(&table, &game, &move)) {
+        printf(", best first move [%d,%d]", move.x, move.y);
+    }
+    printf("\nSolved in %.2f s\n", wallSeconds() - start);
+    
+    freeSolverTable(&table);
+    return 0;
+}
+
+/**
+ * Times full solves with an increasing number of threads.
+ * @param maxThreads - Largest thread count to measure.
+ * @return int - Process exit code.
+ * @details Measures 1, 2, 4, ... threads and always finishes with maxThreads.
+ */
+int runSolverBenchmark(int maxThreads)
+{
+    double baseline = 0;
+    if (maxThreads < 1) {
+        maxThreads = 1;
+    }
+    
+    printf("Threads   Seconds   Speedup\n");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        if (threads * 2 > maxThreads && threads < maxThreads) {
+            threads = maxThreads;
+        }
+        SolverTable table;
+        double start = wallSeconds();
+        if (!solveGame(&table, threads)) {
+            fprintf(stderr, "Not enough memory to solve the game.\n");
+            return 1;
+        }
+        double seconds = wallSeconds() - start;
+        freeSolverTable(&table);
+        
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        printf("%7d %9.2f %8.2fx\n", threads, seconds, baseline / seconds);
+    }
+    return 0;
+}
+
+/**
+ * Maps a whole file read-only into memory.
+ * @param path - The file to map.
+ * @param size - Receives the file size.
+ * @return void* - The mapping, or NULL if the file is missing or empty.
+ * @details Windows builds have no mmap and read the file into memory instead.
+ */
+void* mapFile(const char* path, size_t* size)
+{
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* map = *size > 0 ? malloc(*size) : NULL;
+    if (map != NULL && fread(map, *size, 1, file) != 1) {
+        free(map);
+        map = NULL;
+    }
+    fclose(file);
+    return map;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        *size = (size_t)info.st_size;
+        map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return map == MAP_FAILED ? NULL : map;
+#endif
+}
+
+/**
+ * Releases a mapping made by mapFile.
+ * @param map - The mapping, or NULL.
+ * @param size - Its size.
+ * @return void
+ */
+void unmapFile(void* map, size_t size)
+{
+    if (map == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    (void)size;
+    free(map);
+#else
+    munmap(map, size);
+#endif
+}
+
+/* ------------------------------------------------------------------------
+ * Outcome tablebase files
+ *
+ * A tablebase is a TablebaseHeader, zero padding up to a page boundary, then
+ * the solver's packed 2-bit outcomes (native byte order). Opening a file only
+ * maps it and compares the header with this build's grid and patterns; the
+ * payload is paged in on demand as states are probed, and every process that
+ * maps the same file shares one copy in the page cache.
+ * ------------------------------------------------------------------------ */
+
+#define TABLEBASE_MAGIC "CCDSTRTB"
+#define TABLEBASE_VERSION 1
+#define TABLEBASE_PAYLOAD_OFFSET 4096
+#define TABLEBASE_PAYLOAD_BYTES (STATE_COUNT / 4 + 1)
+#define TABLEBASE_SYMMETRY_GAMES 1000    // Random games whose positions are checked against their canonical form
+
+// Tablebase shown alongside the interactive game (NULL when none was given)
+Tablebase* loadedTablebase = NULL;
+
+/**
+ * Computes the FNV-1a hash of a block of memory.
+ * @param data - The bytes to hash.
+ * @param size - Number of bytes.
+ * @return uint64_t - The 64-bit hash.
+ */
+uint64_t fnv1a(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Fills in a header describing this build's grid and winning patterns.
+ * @param header - The header to fill.
+ * @return void
+ */
+void describeTablebase(TablebaseHeader* header)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, TABLEBASE_MAGIC, sizeof(header->magic));
+    header->version = TABLEBASE_VERSION;
+    header->gridSize = GRID_SIZE;
+    header->numPatterns = NUM_PATTERNS;
+    header->patternLength = PATTERN_LENGTH;
+    header->stateCount = STATE_COUNT;
+    header->payloadBytes = TABLEBASE_PAYLOAD_BYTES;
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        for (int i = 0; i < PATTERN_LENGTH; i++) {
+            header->patternCells[p * PATTERN_LENGTH + i] = (uint8_t)positionToCell(winningPatterns[p][i]);
+        }
+    }
+}
+
+/**
+ * Writes a solved table to a tablebase file.
+ * @param table - A solved table.
+ * @param path - File to create or overwrite.
+ * @return bool - true on success, false if the file could not be written.
+ */
+bool writeTablebase(SolverTable* table, const char* path)
+{
+    TablebaseHeader header;
+    describeTablebase(&header);
+    header.checksum = fnv1a(table->outcomes, TABLEBASE_PAYLOAD_BYTES);
+    
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    
+    uint8_t padding[TABLEBASE_PAYLOAD_OFFSET - sizeof(TablebaseHeader)] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+           && fwrite(padding, sizeof(padding), 1, file) == 1
+           && fwrite(table->outcomes, TABLEBASE_PAYLOAD_BYTES, 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * Maps a tablebase file and checks that it matches this build.
+ * @param tb - Receives the mapping.
+ * @param path - The tablebase file.
+ * @return bool - true if the file was mapped and its header matches, false otherwise.
+ * @details The checksum is not verified here, so opening costs a few system
+ *          calls regardless of the file size; use verifyTablebase for that.
+ */
+bool openTablebase(Tablebase* tb, const char* path)
+{
+    memset(tb, 0, sizeof(*tb));
+    tb->map = mapFile(path, &tb->mapSize);
+    if (tb->map == NULL) {
+        return false;
+    }
+    
+    TablebaseHeader expected;
+    describeTablebase(&expected);
+    tb->header = tb->map;
+    tb->outcomes = (uint8_t*)tb->map + TABLEBASE_PAYLOAD_OFFSET;
+    
+    bool valid = tb->mapSize >= TABLEBASE_PAYLOAD_OFFSET + TABLEBASE_PAYLOAD_BYTES
+              && memcmp(tb->header, &expected, offsetof(TablebaseHeader, checksum)) == 0
+              && memcmp(tb->header->patternCells, expected.patternCells, sizeof(expected.patternCells)) == 0;
+    if (!valid) {
+        closeTablebase(tb);
+    }
+    return valid;
+}
+
+/**
+ * Unmaps a tablebase.
+ * @param tb - The tablebase to close.
+ * @return void
+ */
+void closeTablebase(Tablebase* tb)
+{
+    unmapFile(tb->map, tb->mapSize);
+    memset(tb, 0, sizeof(*tb));
+}
+
+/**
+ * Reads the outcome of a state from a tablebase.
+ * @param tb - An open tablebase.
+ * @param index - The state's index.
+ * @return Outcome - The player who can force a win, or OUTCOME_NONE.
+ */
+Outcome probeTablebase(Tablebase* tb, uint32_t index)
+{
+    return unpackOutcome(tb->outcomes, index);
+}
+
+/**
+ * Checks the payload of a tablebase against its checksum.
+ * @param tb - An open tablebase.
+ * @return bool - true if the checksum matches.
+ * @details Reads the whole payload.
+ */
+bool verifyTablebase(Tablebase* tb)
+{
+    return fnv1a(tb->outcomes, TABLEBASE_PAYLOAD_BYTES) == tb->header->checksum;
+}
+
+/**
+ * Solves the game and writes the result to a tablebase file.
+ * @param path - File to write.
+ * @param threadCount - Number of solver threads.
+ * @return int - Process exit code.
+ */
+int runBuildTablebase(const char* path, int threadCount)
+{
+    SolverTable table;
+    
+    if (!solveGame(&table, threadCount)) {
+        fprintf(stderr, "Not enough memory to solve the game.\n");
+        return 1;
+    }
+    bool ok = writeTablebase(&table, path);
+    freeSolverTable(&table);
+    
+    if (!ok) {
+        fprintf(stderr, "Could not write %s.\n", path);
+        return 1;
+    }
+    printf("Wrote %s (%u states, %u bytes of outcomes)\n", path, STATE_COUNT, TABLEBASE_PAYLOAD_BYTES);
+    return 0;
+}
+
+/**
+ * Opens a tablebase, verifies it and prints the outcome of the initial position.
+ * @param path - The tablebase file.
+ * @return int - Process exit code.
+ * @details Also probes the positions of random games under their canonical
+ *          index: a symmetric position must have the same outcome.
+ */
+int runProbeTablebase(const char* path)
+{
+    Tablebase tb;
+    GameState game;
+    const char* names[4] = {"No forced win", "Uno wins", "Tres wins", "Dos wins"};
+    
+    double start = wallSeconds();
+    if (!openTablebase(&tb, path)) {
+        fprintf(stderr, "%s is missing or was built for a different grid or patterns.\n", path);
+        return 1;
+    }
+    initializeGame(&game);
+    Outcome outcome = probeTablebase(&tb, gameStateIndex(&game));
+    double opened = wallSeconds() - start;
+    
+    printf("Opened and probed in %.3f ms\n", opened * 1000);
+    printf("Initial position: %s\n", names[outcome]);
+    bool ok = verifyTablebase(&tb);
+    printf("Checksum: %s\n", ok ? "ok" : "MISMATCH");
+    
+    uint32_t positions = 0, mismatches = 0;
+    Rng rng;
+    seedRandom(&rng, 1);
+    for (int g = 0; g < TABLEBASE_SYMMETRY_GAMES; g++) {
+        initializeGame(&game);
+        while (!game.over) {
+            playMove(&game, cellToPosition(randomMoveCell(&game, &rng)));
+            mismatches += probeTablebase(&tb, gameStateIndex(&game)) != probeTablebase(&tb, canonicalGameIndex(&game));
+            positions++;
+        }
+    }
+    printf("Symmetric positions: %u probed, %u mismatch(es)\n", positions, mismatches);
+    ok = ok && mismatches == 0;
+    
+    closeTablebase(&tb);
+    return ok ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Headless batch replay
+ *
+ * Input holds one game per line as the moves typed into main, "x y" pairs
+ * separated by whitespace ("1 1 4 4 1 1 ..."). Blank lines and lines starting
+ * with '#' are skipped. Games are replayed through playMove without drawing
+ * anything.
+ *
+ * All move text, including what is typed into the game, goes through an
+ * InputBuffer: it is read with read() in chunks of INPUT_BUFFER_SIZE and the
+ * numbers are parsed straight out of the buffer, instead of a stdio call per
+ * character or per move. On a terminal each read returns one line, so typing
+ * works as before; piped input arrives in large chunks.
+ * ------------------------------------------------------------------------ */
+
+#define TOKEN_NUMBER 1
+#define TOKEN_END_OF_LINE 0
+#define TOKEN_END_OF_FILE -1
+#define TOKEN_INVALID -2
+
+/**
+ * Opens a file, or standard input, for chunked reading.
+ * @param input - The input buffer.
+ * @param path - File to read, or "-" for standard input.
+ * @return bool - true on success.
+ */
+bool openInput(InputBuffer* input, const char* path)
+{
+    bool console = strcmp(path, "-") == 0;
+    input->position = 0;
+    input->length = 0;
+    input->consumed = 0;
+    input->ended = false;
+    input->file = NULL;
+    input->fd = -1;
+    #ifdef _WIN32
+        input->file = console ? stdin : fopen(path, "rb");
+        return input->file != NULL;
+    #else
+        input->fd = console ? STDIN_FILENO : open(path, O_RDONLY);
+        return input->fd >= 0;
+    #endif
+}
+
+/**
+ * Closes an input opened with openInput, leaving standard input open.
+ * @param input - The input buffer.
+ * @return void
+ */
+void closeInput(InputBuffer* input)
+{
+    if (input->file != NULL && input->file != stdin) {
+        fclose(input->file);
+    }
+    #ifndef _WIN32
+        if (input->fd > STDIN_FILENO) {
+            close(input->fd);
+        }
+    #endif
+}
+
+/**
+ * Reads the next chunk of an input once every byte of the last one is used.
+ * @param input - The input buffer.
+ * @return bool - true if there are unread bytes, false at the end of the input.
+ * @details A terminal or console returns one line per read (read() on
+ *          POSIX, _read() on the descriptor of the stream on Windows), so
+ *          this never waits for more than the user has typed.
+ */
+bool fillInput(InputBuffer* input)
+{
+    if (input->position < input->length) {
+        return true;
+    }
+    input->position = 0;
+    input->length = 0;
+    while (!input->ended) {
+        #ifdef _WIN32
+            // fread would wait for a full buffer; _read on the console returns each line
+            int got = _read(_fileno(input->file), input->data, INPUT_BUFFER_SIZE);
+            if (got <= 0) {
+                input->ended = true;
+                break;
+            }
+        #else
+            ssize_t got = read(input->fd, input->data, INPUT_BUFFER_SIZE);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                input->ended = true;
+                break;
+            }
+        #endif
+        input->length = (size_t)got;
+        input->consumed += (uint64_t)got;
+        return got > 0;
+    }
+    return false;
+}
+
+/**
+ * Reads one byte of an input.
+ * @param input - The input buffer.
+ * @return int - The byte, or EOF at the end of the input.
+ */
+int readInputByte(InputBuffer* input)
+{
+    if (input->position == input->length && !fillInput(input)) {
+        return EOF;
+    }
+    return (unsigned char)input->data[input->position++];
+}
+
+/**
+ * Looks at the next byte of an input without reading it.
+ * @param input - The input buffer.
+ * @return int - The byte, or EOF at the end of the input.
+ */
+int peekInputByte(InputBuffer* input)
+{
+    if (input->position == input->length && !fillInput(input)) {
+        return EOF;
+    }
+    return (unsigned char)input->data[input->position];
+}
+
+/**
+ * Skips the rest of the current line, including its newline.
+ * @param input - The input buffer.
+ * @return void
+ */
+void skipInputLine(InputBuffer* input)
+{
+    while (fillInput(input)) {
+        char* newline = memchr(input->data + input->position, '\n', input->length - input->position);
+        if (newline != NULL) {
+            input->position = (size_t)(newline - input->data) + 1;
+            return;
+        }
+        input->position = input->length;
+    }
+}
+
+/**
+ * Checks whether a whole move has already been read.
+ * @param input - The input buffer.
+ * @return bool - true if the unread bytes start with two complete integers.
+ * @details Never reads, so it does not block. A number counts as complete
+ *          once some other byte follows it in the buffer.
+ */
+bool inputHasMove(InputBuffer* input)
+{
+    size_t i = input->position;
+    
+    for (int number = 0; number < 2; number++) {
+        while (i < input->length && (input->data[i] == ' ' || input->data[i] == '\t' || input->data[i] == '\r'
+                                     || input->data[i] == '\n' || input->data[i] == '\v' || input->data[i] == '\f')) {
+            i++;
+        }
+        if (i < input->length && (input->data[i] == '-' || input->data[i] == '+')) {
+            i++;
+        }
+        size_t digits = i;
+        while (i < input->length && input->data[i] >= '0' && input->data[i] <= '9') {
+            i++;
+        }
+        if (i == digits || i == input->length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads a decimal integer the way scanf's %d does.
+ * @param input - The input buffer.
+ * @param value - Receives the number when one is read.
+ * @return int - 1 if a number was read, 0 if the next text is not a number, or
+ *               EOF if the input ended first.
+ * @details Skips whitespace including newlines, accepts a sign, and stops at
+ *          the first byte that is not a digit without reading it.
+ */
+int readInteger(InputBuffer* input, int* value)
+{
+    int c;
+    while ((c = peekInputByte(input)) == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f') {
+        input->position++;
+    }
+    if (c == EOF) {
+        return EOF;
+    }
+    
+    bool negative = c == '-';
+    if (c == '-' || c == '+') {
+        input->position++;
+        c = peekInputByte(input);
+    }
+    if (c < '0' || c > '9') {
+        return 0;
+    }
+    long number = 0;
+    for (; c >= '0' && c <= '9'; c = peekInputByte(input)) {
+        if (number < 100000000) {
+            number = number * 10 + (c - '0');
+        }
+        input->position++;
+    }
+    *value = (int)(negative ? -number : number);
+    return 1;
+}
+
+/**
+ * Reads a move as two integers, as scanf("%d %d") would.
+ * @param input - The input buffer.
+ * @param x - Receives the first number.
+ * @param y - Receives the second number.
+ * @return int - Numbers read (0, 1 or 2), or EOF if the input ended before the first.
+ */
+int readCoordinates(InputBuffer* input, int* x, int* y)
+{
+    int first = readInteger(input, x);
+    if (first != 1) {
+        return first;
+    }
+    return readInteger(input, y) == 1 ? 2 : 1;
+}
+
+/**
+ * Reads the next whitespace-separated integer of a move stream.
+ * @param input - The input buffer.
+ * @param value - Receives the number when one is read.
+ * @return int - TOKEN_NUMBER, TOKEN_END_OF_LINE, TOKEN_END_OF_FILE or TOKEN_INVALID.
+ * @details An invalid token is skipped up to the next whitespace. Bytes are
+ *          taken straight from the buffer, refilling it only at its end.
+ */
+int readMoveToken(InputBuffer* input, int* value)
+{
+    int c;
+    do {
+        c = readInputByte(input);
+    } while (c == ' ' || c == '\t' || c == '\r');
+    
+    if (c == EOF) {
+        return TOKEN_END_OF_FILE;
+    }
+    if (c == '\n') {
+        return TOKEN_END_OF_LINE;
+    }
+    if (c == '#') {
+        skipInputLine(input);
+        return TOKEN_END_OF_LINE;
+    }
+    
+    bool digits = false, valid = true;
+    int number = 0;
+    for (;;) {
+        if (c >= '0' && c <= '9' && number < 100000) {
+            number = number * 10 + (c - '0');
+            digits = true;
+        } else {
+            valid = false;
+        }
+        c = peekInputByte(input);
+        if (c == EOF || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            break;
+        }
+        input->position++;
+    }
+    
+    *value = number;
+    return digits && valid ? TOKEN_NUMBER : TOKEN_INVALID;
+}
+
+/**
+ * Replays every game of a move stream and reports the outcomes.
+ * @param path - File to read, or "-" for standard input.
+ * @param perGame - true to print one line per game, false for the totals only.
+ * @return int - Process exit code.
+ */
+int runBatch(const char* path, bool perGame)
+{
+    InputBuffer* input = malloc(sizeof(InputBuffer));
+    if (input == NULL || !openInput(input, path)) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        free(input);
+        return 1;
+    }
+    
+    const char* names[4] = {"unfinished", "Uno wins", "Tres wins", "Dos wins"};
+    uint64_t games = 0, illegal = 0, totals[4] = {0};
+    double start = wallSeconds();
+    int token = TOKEN_END_OF_LINE;
+    
+    while (token != TOKEN_END_OF_FILE) {
+        GameState game;
+        int moves = 0, badMove = 0, coordinates[2], count = 0, value;
+        
+        initializeGame(&game);
+        while ((token = readMoveToken(input, &value)) != TOKEN_END_OF_LINE && token != TOKEN_END_OF_FILE) {
+            if (badMove) {
+                continue;
+            }
+            if (token == TOKEN_INVALID) {
+                badMove = moves + 1;
+                continue;
+            }
+            coordinates[count++] = value;
+            if (count == 2) {
+                Position pos = {coordinates[0], coordinates[1]};
+                count = 0;
+                moves++;
+                if (!playMove(&game, pos)) {
+                    badMove = moves;
+                }
+            }
+        }
+        if (count != 0 && !badMove) {
+            badMove = moves + 1;
+        }
+        if (moves == 0 && !badMove) {
+            continue;
+        }
+        
+        games++;
+        Outcome winner = gameWinner(&game);
+        if (badMove) {
+            illegal++;
+        } else {
+            totals[winner]++;
+        }
+        
+        if (perGame) {
+            if (badMove) {
+                printf("game %llu: illegal move %d\n", (unsigned long long)games, badMove);
+            } else {
+                printf("game %llu: %s after %d moves\n", (unsigned long long)games, names[winner], moves);
+            }
+        }
+    }
+    
+    double seconds = wallSeconds() - start;
+    closeInput(input);
+    free(input);
+    
+    printf("Games: %llu  Uno: %llu  Tres: %llu  Dos: %llu  Unfinished: %llu  Illegal: %llu\n",
+           (unsigned long long)games, (unsigned long long)totals[OUTCOME_UNO],
+           (unsigned long long)totals[OUTCOME_TRES], (unsigned long long)totals[OUTCOME_DOS],
+           (unsigned long long)totals[OUTCOME_NONE], (unsigned long long)illegal);
+    fprintf(stderr, "Replayed in %.3f s (%.0f games/s)\n", seconds, seconds > 0 ? games / seconds : 0.0);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Binary game records
+ *
+ * A record file starts with an 8-byte magic and a 32-bit version, followed
+ * by one record per game:
+ *   2 bytes   move count n (little endian)
+ *   1 byte    recorded result (an Outcome; OUTCOME_NONE if unfinished)
+ *   1 byte    reserved, zero
+ *   (n+1)/2   moves as 4-bit cell indices, low nibble first
+ *   4 * (n / RECORD_KEYFRAME_INTERVAL)
+ *             keyframes: Uno and Tres masks (little endian) after every
+ *             RECORD_KEYFRAME_INTERVAL moves
+ * Who moves is implied by the turn/go sequence (Tres, Uno, Dos, Tres, ...),
+ * so a move needs only its cell. Keyframes let a reader start replaying in
+ * the middle of a long game.
+ * ------------------------------------------------------------------------ */
+
+#define RECORD_MAGIC "CCDSTRGR"
+#define RECORD_VERSION 1
+#define RECORD_FILE_HEADER 12
+#define RECORD_HEADER 4
+
+/**
+ * Computes the size of a record with a given number of moves.
+ * @param moveCount - Number of moves in the game.
+ * @return size_t - Bytes taken by the record.
+ */
+size_t recordSize(int moveCount)
+{
+    return RECORD_HEADER + (moveCount + 1) / 2 + 4 * (moveCount / RECORD_KEYFRAME_INTERVAL);
+}
+
+/**
+ * Creates a record file and writes its header.
+ * @param writer - The writer to set up.
+ * @param path - File to create or overwrite.
+ * @return bool - false if the file could not be created.
+ */
+bool openRecordWriter(RecordWriter* writer, const char* path)
+{
+    uint8_t header[RECORD_FILE_HEADER] = {0};
+    memcpy(header, RECORD_MAGIC, 8);
+    header[8] = RECORD_VERSION;
+    
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL || fwrite(header, sizeof(header), 1, writer->file) != 1) {
+        if (writer->file != NULL) {
+            fclose(writer->file);
+            writer->file = NULL;
+        }
+        return false;
+    }
+    writer->moveCount = 0;
+    initializeGame(&writer->game);
+    return true;
+}
+
+/**
+ * Adds a move to the game being recorded.
+ * @param writer - The writer.
+ * @param pos - The position played.
+ * @return bool - false if the move is illegal or the record is full; nothing is recorded then.
+ */
+bool recordMove(RecordWriter* writer, Position pos)
+{
+    if (writer->moveCount == RECORD_MAX_MOVES || !playMove(&writer->game, pos)) {
+        return false;
+    }
+    
+    int cell = positionToCell(pos);
+    int index = writer->moveCount++;
+    if (index % 2 == 0) {
+        writer->moves[index / 2] = (uint8_t)cell;
+    } else {
+        writer->moves[index / 2] |= (uint8_t)(cell << 4);
+    }
+    
+    if (writer->moveCount % RECORD_KEYFRAME_INTERVAL == 0) {
+        uint8_t* keyframe = &writer->keyframes[(writer->moveCount / RECORD_KEYFRAME_INTERVAL - 1) * 4];
+        SetMask uno = setToMask(writer->game.Uno), tres = setToMask(writer->game.Tres);
+        keyframe[0] = (uint8_t)uno;
+        keyframe[1] = (uint8_t)(uno >> 8);
+        keyframe[2] = (uint8_t)tres;
+        keyframe[3] = (uint8_t)(tres >> 8);
+    }
+    return true;
+}
+
+/**
+ * Writes the game being recorded and starts a new one.
+ * @param writer - The writer.
+ * @return bool - false if the write failed.
+ */
+bool endRecord(RecordWriter* writer)
+{
+    int count = writer->moveCount;
+    uint8_t header[RECORD_HEADER] = {(uint8_t)count, (uint8_t)(count >> 8),
+                                     (uint8_t)gameWinner(&writer->game), 0};
+    bool ok = fwrite(header, sizeof(header), 1, writer->file) == 1
+           && fwrite(writer->moves, (count + 1) / 2, 1, writer->file) == (count > 0 ? 1u : 0u)
+           && fwrite(writer->keyframes, 4, count / RECORD_KEYFRAME_INTERVAL, writer->file)
+              == (size_t)(count / RECORD_KEYFRAME_INTERVAL);
+    
+    writer->moveCount = 0;
+    initializeGame(&writer->game);
+    return ok;
+}
+
+/**
+ * Closes a record file.
+ * @param writer - The writer.
+ * @return bool - false if flushing the file failed.
+ */
+bool closeRecordWriter(RecordWriter* writer)
+{
+    return fclose(writer->file) == 0;
+}
+
+/**
+ * Maps a record file for reading.
+ * @param reader - The reader to set up.
+ * @param path - The record file.
+ * @return bool - false if the file is missing or is not a record file.
+ */
+bool openRecordReader(RecordReader* reader, const char* path)
+{
+    reader->map = mapFile(path, &reader->size);
+    reader->offset = RECORD_FILE_HEADER;
+    if (reader->map == NULL) {
+        return false;
+    }
+    if (reader->size < RECORD_FILE_HEADER || memcmp(reader->map, RECORD_MAGIC, 8) != 0
+        || reader->map[8] != RECORD_VERSION) {
+        closeRecordReader(reader);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the record starting at a given offset without copying it.
+ * @param reader - The reader.
+ * @param offset - Offset of the record in the file.
+ * @param record - Receives pointers into the mapping.
+ * @return int - 1 if a record was read, 0 at the end of the file, -1 if the
+ *               record header is damaged or the record runs past the end.
+ */
+int readRecordAt(RecordReader* reader, size_t offset, GameRecord* record)
+{
+    if (offset == reader->size) {
+        return 0;
+    }
+    
+    uint8_t* header = reader->map + offset;
+    if (reader->size - offset < RECORD_HEADER || header[2] > OUTCOME_DOS || header[3] != 0) {
+        return -1;
+    }
+    record->offset = offset;
+    record->moveCount = header[0] | (header[1] << 8);
+    record->result = (Outcome)header[2];
+    if (reader->size - offset < recordSize(record->moveCount)) {
+        return -1;
+    }
+    
+    record->moves = header + RECORD_HEADER;
+    record->keyframes = record->moves + (record->moveCount + 1) / 2;
+    return 1;
+}
+
+/**
+ * Steps to the next record without copying it.
+ * @param reader - The reader.
+ * @param record - Receives pointers into the mapping.
+ * @return int - Same as readRecordAt.
+ */
+int nextRecord(RecordReader* reader, GameRecord* record)
+{
+    int status = readRecordAt(reader, reader->offset, record);
+    if (status == 1) {
+        reader->offset += recordSize(record->moveCount);
+    }
+    return status;
+}
+
+/**
+ * Unmaps a record file.
+ * @param reader - The reader.
+ * @return void
+ */
+void closeRecordReader(RecordReader* reader)
+{
+    unmapFile(reader->map, reader->size);
+    reader->map = NULL;
+}
+
+/**
+ * Decodes one move of a record.
+ * @param record - The record.
+ * @param index - Move number, from 0.
+ * @return Position - The position played.
+ */
+Position recordedMove(GameRecord* record, int index)
+{
+    return cellToPosition((record->moves[index / 2] >> ((index % 2) * 4)) & 0xF);
+}
+
+/**
+ * Rebuilds the game state after a number of moves of a record.
+ * @param record - The record.
+ * @param moveIndex - Number of moves to apply, at most record->moveCount.
+ * @param game - Receives the game state.
+ * @return bool - false if a move replayed after the keyframe is illegal.
+ * @details Starts from the nearest keyframe at or before moveIndex, so at most
+ *          RECORD_KEYFRAME_INTERVAL - 1 moves are replayed.
+ */
+bool recordStateAt(GameRecord* record, int moveIndex, GameState* game)
+{
+    int start = moveIndex / RECORD_KEYFRAME_INTERVAL * RECORD_KEYFRAME_INTERVAL;
+    
+    initializeGame(game);
+    if (start > 0) {
+        uint8_t* keyframe = &record->keyframes[(start / RECORD_KEYFRAME_INTERVAL - 1) * 4];
+        SetMask uno = (SetMask)(keyframe[0] | (keyframe[1] << 8));
+        SetMask tres = (SetMask)(keyframe[2] | (keyframe[3] << 8));
+        // Tres, Uno and Dos take turns, so the move number gives the phase
+        setGamePosition(game, uno, tres, (Phase)(start % 3));
+        game->moveCount = (uint32_t)start;
+    }
+    
+    for (int i = start; i < moveIndex; i++) {
+        if (!playMove(game, recordedMove(record, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Converts a text move log (the --batch format) into a record file.
+ * @param textPath - Text log to read, or "-" for standard input.
+ * @param recordPath - Record file to write.
+ * @return int - Process exit code.
+ * @details Games with an illegal or malformed move are left out.
+ */
+int runEncodeRecords(const char* textPath, const char* recordPath)
+{
+    InputBuffer* input = malloc(sizeof(InputBuffer));
+    RecordWriter* writer = malloc(sizeof(RecordWriter));
+    bool opened = input != NULL && openInput(input, textPath);
+    if (!opened || writer == NULL || !openRecordWriter(writer, recordPath)) {
+        fprintf(stderr, "Could not open %s or %s.\n", textPath, recordPath);
+        if (opened) {
+            closeInput(input);
+        }
+        free(input);
+        free(writer);
+        return 1;
+    }
+    
+    uint64_t written = 0, skipped = 0, textBytes = 0;
+    int token = TOKEN_END_OF_LINE;
+    while (token != TOKEN_END_OF_FILE) {
+        int coordinates[2], count = 0, value;
+        bool bad = false;
+        
+        while ((token = readMoveToken(input, &value)) != TOKEN_END_OF_LINE && token != TOKEN_END_OF_FILE) {
+            coordinates[count++ % 2] = value;
+            if (token == TOKEN_INVALID) {
+                bad = true;
+            }
+            if (!bad && count % 2 == 0) {
+                Position pos = {coordinates[0], coordinates[1]};
+                bad = !recordMove(writer, pos);
+            }
+        }
+        
+        if (count == 0) {
+            continue;
+        }
+        if (bad || count % 2 != 0) {
+            writer->moveCount = 0;
+            initializeGame(&writer->game);
+            skipped++;
+        } else if (endRecord(writer)) {
+            written++;
+        }
+    }
+    
+    textBytes = input->consumed;
+    closeInput(input);
+    free(input);
+    bool ok = closeRecordWriter(writer);
+    free(writer);
+    
+    FILE* output = fopen(recordPath, "rb");
+    long recordBytes = 0;
+    if (output != NULL) {
+        fseek(output, 0, SEEK_END);
+        recordBytes = ftell(output);
+        fclose(output);
+    }
+    printf("Encoded %llu games (%llu skipped) into %ld bytes", (unsigned long long)written,
+           (unsigned long long)skipped, recordBytes);
+    if (textBytes > 0 && recordBytes > 0) {
+        printf(", %.1fx smaller than the text log", (double)textBytes / recordBytes);
+    }
+    printf("\n");
+    return ok ? 0 : 1;
+}
+
+/**
+ * Replays every game of a record file and reports the outcomes.
+ * @param path - The record file.
+ * @return int - Process exit code.
+ */
+int runReplayRecords(const char* path)
+{
+    RecordReader reader;
+    GameRecord record;
+    uint64_t games = 0, moves = 0, totals[4] = {0};
+    int status;
+    
+    if (!openRecordReader(&reader, path)) {
+        fprintf(stderr, "%s is missing or is not a game record file.\n", path);
+        return 1;
+    }
+    
+    double start = wallSeconds();
+    while ((status = nextRecord(&reader, &record)) == 1) {
+        GameState game;
+        initializeGame(&game);
+        for (int i = 0; i < record.moveCount; i++) {
+            playMove(&game, recordedMove(&record, i));
+        }
+        totals[gameWinner(&game)]++;
+        moves += record.moveCount;
+        games++;
+    }
+    double seconds = wallSeconds() - start;
+    
+    printf("Games: %llu  Uno: %llu  Tres: %llu  Dos: %llu  Unfinished: %llu\n",
+           (unsigned long long)games, (unsigned long long)totals[OUTCOME_UNO],
+           (unsigned long long)totals[OUTCOME_TRES], (unsigned long long)totals[OUTCOME_DOS],
+           (unsigned long long)totals[OUTCOME_NONE]);
+    if (status < 0) {
+        printf("Damaged record at offset %zu\n", reader.offset);
+    }
+    fprintf(stderr, "Replayed %llu moves in %.3f s (%.0f games/s, %.1f MB/s)\n",
+            (unsigned long long)moves, seconds, seconds > 0 ? games / seconds : 0.0,
+            seconds > 0 ? reader.offset / seconds / 1e6 : 0.0);
+    
+    closeRecordReader(&reader);
+    return status < 0 ? 1 : 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Parallel record validation
+ *
+ * A first pass walks the record headers to find where every game starts
+ * (a damaged header ends the walk, since nothing after it can be located).
+ * The games are then split into contiguous shards, one per thread, and each
+ * thread replays its games through playMove, checking every move, every
+ * keyframe and the recorded winner. The state recordStateAt rebuilds at
+ * every keyframe and at the end of the game is compared with the replayed
+ * one, so random access into a record is checked along the way. Shards only write their own counters and
+ * problem lists, which are merged after the threads finish.
+ * ------------------------------------------------------------------------ */
+
+#define RECORD_VALID 0
+#define RECORD_ILLEGAL_MOVE 1
+#define RECORD_BAD_KEYFRAME 2
+#define RECORD_WRONG_RESULT 3
+#define RECORD_BAD_DECODE 4
+
+/**
+ * Replays a record and checks it against the rules.
+ * @param record - The record to check.
+ * @param move - Receives the move (from 1) or keyframe number of the first problem.
+ * @return int - RECORD_VALID or the kind of the first problem found.
+ * @details A move is illegal if nextPlayerMove rejects it or the game was already over.
+ */
+int validateRecord(GameRecord* record, int* move)
+{
+    GameState game, rebuilt;
+    initializeGame(&game);
+    
+    for (int i = 0; i <= record->moveCount; i++) {
+        // Random access must land on the replayed state at keyframes and at the end
+        if ((i % RECORD_KEYFRAME_INTERVAL == 0 || i == record->moveCount)
+            && (!recordStateAt(record, i, &rebuilt) || setToMask(rebuilt.Uno) != setToMask(game.Uno)
+                || setToMask(rebuilt.Tres) != setToMask(game.Tres) || gamePhase(&rebuilt) != gamePhase(&game)
+                || rebuilt.over != game.over || rebuilt.moveCount != game.moveCount)) {
+            *move = i;
+            return RECORD_BAD_DECODE;
+        }
+        if (i == record->moveCount) {
+            break;
+        }
+        
+        if (!playMove(&game, recordedMove(record, i))) {
+            *move = i + 1;
+            return RECORD_ILLEGAL_MOVE;
+        }
+        
+        if ((i + 1) % RECORD_KEYFRAME_INTERVAL == 0) {
+            int keyframe = (i + 1) / RECORD_KEYFRAME_INTERVAL;
+            uint8_t* bytes = &record->keyframes[(keyframe - 1) * 4];
+            SetMask uno = (SetMask)(bytes[0] | (bytes[1] << 8));
+            SetMask tres = (SetMask)(bytes[2] | (bytes[3] << 8));
+            if (uno != setToMask(game.Uno) || tres != setToMask(game.Tres)) {
+                *move = keyframe;
+                return RECORD_BAD_KEYFRAME;
+            }
+        }
+    }
+    
+    if (gameWinner(&game) != record->result) {
+        *move = record->moveCount;
+        return RECORD_WRONG_RESULT;
+    }
+    return RECORD_VALID;
+}
+
+/**
+ * Validates one shard of games.
+ * @param arg - Pointer to the thread's ValidatorShard.
+ * @return void* - Always NULL.
+ */
+void* validateShard(void* arg)
+{
+    ValidatorShard* shard = arg;
+    
+    for (size_t i = shard->first; i < shard->last; i++) {
+        GameRecord record;
+        int move = 0;
+        readRecordAt(shard->reader, shard->offsets[i], &record);
+        
+        int kind = validateRecord(&record, &move);
+        shard->moves += record.moveCount;
+        if (kind == RECORD_VALID) {
+            continue;
+        }
+        
+        shard->badGames++;
+        if (shard->problemCount < RECORD_PROBLEMS_KEPT) {
+            RecordProblem problem = {record.offset, kind, move};
+            shard->problems[shard->problemCount++] = problem;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Validates every game of a record file using several threads.
+ * @param path - The record file.
+ * @param threadCount - Number of worker threads.
+ * @return int - Process exit code: 0 if every game is valid.
+ */
+int runValidateRecords(const char* path, int threadCount)
+{
+    RecordReader reader;
+    GameRecord record;
+    size_t capacity = 1024, games = 0;
+    int status = 0;
+    
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    if (!openRecordReader(&reader, path)) {
+        fprintf(stderr, "%s is missing or is not a game record file.\n", path);
+        return 1;
+    }
+    
+    double start = wallSeconds();
+    size_t* offsets = malloc(capacity * sizeof(size_t));
+    while (offsets != NULL && (status = nextRecord(&reader, &record)) == 1) {
+        if (games == capacity) {
+            capacity *= 2;
+            size_t* grown = realloc(offsets, capacity * sizeof(size_t));
+            if (grown == NULL) {
+                free(offsets);
+                offsets = NULL;
+                break;
+            }
+            offsets = grown;
+        }
+        offsets[games++] = record.offset;
+    }
+    
+    ValidatorShard* shards = calloc(threadCount, sizeof(ValidatorShard));
+    RecordProblem* problems = malloc((size_t)threadCount * RECORD_PROBLEMS_KEPT * sizeof(RecordProblem));
+    pthread_t* threads = malloc(threadCount * sizeof(pthread_t));
+    bool* running = calloc(threadCount, sizeof(bool));
+    if (offsets == NULL || shards == NULL || problems == NULL || threads == NULL || running == NULL) {
+        fprintf(stderr, "Not enough memory to validate %s.\n", path);
+        free(offsets);
+        free(shards);
+        free(problems);
+        free(threads);
+        free(running);
+        closeRecordReader(&reader);
+        return 1;
+    }
+    
+    for (int t = 0; t < threadCount; t++) {
+        shards[t].reader = &reader;
+        shards[t].offsets = offsets;
+        shards[t].first = games * t / threadCount;
+        shards[t].last = games * (t + 1) / threadCount;
+        shards[t].problems = &problems[(size_t)t * RECORD_PROBLEMS_KEPT];
+        running[t] = pthread_create(&threads[t], NULL, validateShard, &shards[t]) == 0;
+        if (!running[t]) {
+            validateShard(&shards[t]);
+        }
+    }
+    
+    uint64_t moves = 0, badGames = 0;
+    const char* kinds[5] = {"valid", "illegal move", "keyframe mismatch at keyframe", "recorded winner differs after move",
+                            "random access decode differs at move"};
+    for (int t = 0; t < threadCount; t++) {
+        if (running[t]) {
+            pthread_join(threads[t], NULL);
+        }
+        moves += shards[t].moves;
+        badGames += shards[t].badGames;
+    }
+    double seconds = wallSeconds() - start;
+    
+    // Shards cover increasing offsets, so their lists print in file order
+    for (int t = 0; t < threadCount; t++) {
+        for (int i = 0; i < shards[t].problemCount; i++) {
+            RecordProblem* problem = &shards[t].problems[i];
+            printf("offset %zu: %s %d\n", problem->offset, kinds[problem->kind], problem->move);
+        }
+    }
+    if (status < 0) {
+        printf("offset %zu: damaged record header, remaining records skipped\n", reader.offset);
+    }
+    printf("Validated %zu games (%llu moves) with %d thread(s) in %.3f s: %.0f games/s, %llu bad\n",
+           games, (unsigned long long)moves, threadCount, seconds,
+           seconds > 0 ? games / seconds : 0.0, (unsigned long long)badGames);
+    
+    free(offsets);
+    free(shards);
+    free(problems);
+    free(threads);
+    free(running);
+    closeRecordReader(&reader);
+    return badGames == 0 && status == 0 ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Search engine for computer seats
+ *
+ * Three-player games are searched with the paranoid model: the engine's
+ * seat plays against the other two, which pick the moves worst for it. That
+ * turns the game into two sides, and the search is written in negamax form,
+ * flipping the sign and the window only where the side to move changes (Uno
+ * and Dos move back to back when Tres is the seat, for example). Iterative
+ * deepening runs until the time budget or the depth limit is reached, and a
+ * transposition table keyed by the Zobrist position key stores bounds and
+ * best moves. Every round of Tres, Uno and Dos adds one piece to the board,
+ * so no position can repeat along a search path and none is checked for.
+ *
+ * The table is shared by all seats and search threads without locks. Each
+ * 16-byte entry stores its key XORed with its data; a reader recomputes the
+ * key from both words and treats a mismatch (another thread's half-finished
+ * write) as a miss. Extra threads use Lazy SMP: they run the same iterative
+ * deepening, staggered by one ply, and only help through the table; the
+ * calling thread's result is the one played.
+ * ------------------------------------------------------------------------ */
+
+#define SCORE_WIN 10000
+#define SCORE_INFINITE 30000
+#define BOUND_EXACT 0
+#define BOUND_LOWER 1
+#define BOUND_UPPER 2
+
+#define TABLE_PLAIN_PAGES 0
+#define TABLE_TRANSPARENT_HUGE_PAGES 1
+#define TABLE_HUGE_PAGES 2
+#define HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+#define ENTRY_VALUE(data) ((int)(int16_t)((data) & 0xFFFF))
+#define ENTRY_DEPTH(data) ((int)(((data) >> 16) & 0xFF))
+#define ENTRY_BOUND(data) ((int)(((data) >> 24) & 0x3))
+#define ENTRY_MOVE(data) ((int)(((data) >> 26) & 0x1F) - 1)
+#define ENTRY_GENERATION(data) ((uint8_t)((data) >> 32))
+
+/**
+ * Allocates a zeroed shared transposition table.
+ * @param table - The table to set up.
+ * @param megabytes - Size limit; the bucket count is rounded down to a power of two.
+ * @return bool - false if the memory could not be allocated.
+ * @details Tries explicit huge pages first (Linux, when the system has some
+ *          reserved), then a 2 MB-aligned block with transparent huge pages
+ *          requested, then ordinary pages. Huge pages keep the random probes
+ *          of a large table from missing the TLB on nearly every access.
+ */
+bool initializeSharedTable(SharedTable* table, size_t megabytes)
+{
+    size_t buckets = 1;
+    while (buckets * 2 * sizeof(TableBucket) <= (megabytes << 20)) {
+        buckets *= 2;
+    }
+    
+    memset(table, 0, sizeof(*table));
+    table->bytes = buckets * sizeof(TableBucket);
+    table->bucketMask = buckets - 1;
+    
+    void* memory = NULL;
+    #if defined(__linux__) && defined(MAP_HUGETLB)
+    if (table->bytes >= HUGE_PAGE_BYTES) {
+        memory = mmap(NULL, table->bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory == MAP_FAILED) {
+            memory = NULL;
+        } else {
+            table->backing = TABLE_HUGE_PAGES;
+        }
+    }
+    #endif
+    if (memory == NULL) {
+        #ifdef _WIN32
+            memory = _aligned_malloc(table->bytes, sizeof(TableBucket));
+        #else
+            size_t alignment = table->bytes >= HUGE_PAGE_BYTES ? HUGE_PAGE_BYTES : sizeof(TableBucket);
+            if (posix_memalign(&memory, alignment, table->bytes) != 0) {
+                memory = NULL;
+            }
+            #ifdef MADV_HUGEPAGE
+            if (memory != NULL && alignment == HUGE_PAGE_BYTES
+                && madvise(memory, table->bytes, MADV_HUGEPAGE) == 0) {
+                table->backing = TABLE_TRANSPARENT_HUGE_PAGES;
+            }
+            #endif
+        #endif
+        if (memory == NULL) {
+            return false;
+        }
+        memset(memory, 0, table->bytes);
+    }
+    table->buckets = memory;
+    return true;
+}
+
+/**
+ * Releases a shared transposition table.
+ * @param table - The table.
+ * @return void
+ */
+void freeSharedTable(SharedTable* table)
+{
+    #ifdef _WIN32
+        _aligned_free(table->buckets);
+    #else
+        if (table->backing == TABLE_HUGE_PAGES) {
+            munmap(table->buckets, table->bytes);
+        } else {
+            free(table->buckets);
+        }
+    #endif
+    table->buckets = NULL;
+}
+
+/**
+ * Packs a search result into the data word of a table entry.
+ * @param value - Score, already made relative to the node for win/loss scores.
+ * @param depth - Remaining depth searched (at least 1, so stored data is never zero).
+ * @param bound - BOUND_EXACT, BOUND_LOWER or BOUND_UPPER.
+ * @param move - Best cell, or -1.
+ * @param generation - The table's current generation.
+ * @return uint64_t - The data word, read back with the ENTRY_ macros.
+ */
+uint64_t packTableData(int value, int depth, int bound, int move, uint8_t generation)
+{
+    return (uint64_t)(uint16_t)value
+         | (uint64_t)(depth & 0xFF) << 16
+         | (uint64_t)bound << 24
+         | (uint64_t)(move + 1) << 26
+         | (uint64_t)generation << 32;
+}
+
+/**
+ * Looks a position up in the shared table.
+ * @param table - The table.
+ * @param key - Position key.
+ * @param data - Receives the entry's data word on a hit.
+ * @return bool - true if a valid entry for the key was found.
+ */
+bool probeSharedTable(SharedTable* table, uint64_t key, uint64_t* data)
+{
+    TableEntry* entries = table->buckets[key & table->bucketMask].entries;
+    
+    for (int i = 0; i < TABLE_BUCKET_ENTRIES; i++) {
+        uint64_t word = __atomic_load_n(&entries[i].data, __ATOMIC_RELAXED);
+        uint64_t check = __atomic_load_n(&entries[i].check, __ATOMIC_RELAXED);
+        if (word != 0 && (check ^ word) == key) {
+            *data = word;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Stores a position in the shared table.
+ * @param table - The table.
+ * @param key - Position key.
+ * @param data - Data word from packTableData.
+ * @return void
+ * @details Overwrites the bucket's entry for the same key if there is one;
+ *          otherwise replaces the shallowest entry, preferring entries left
+ *          over from earlier root searches.
+ */
+void storeSharedTable(SharedTable* table, uint64_t key, uint64_t data)
+{
+    TableEntry* entries = table->buckets[key & table->bucketMask].entries;
+    TableEntry* victim = &entries[0];
+    int victimScore = 1 << 30;
+    
+    for (int i = 0; i < TABLE_BUCKET_ENTRIES; i++) {
+        uint64_t word = __atomic_load_n(&entries[i].data, __ATOMIC_RELAXED);
+        uint64_t check = __atomic_load_n(&entries[i].check, __ATOMIC_RELAXED);
+        if (word == 0 || (check ^ word) == key) {
+            victim = &entries[i];
+            break;
+        }
+        int score = ENTRY_DEPTH(word) - (ENTRY_GENERATION(word) != table->generation ? 256 : 0);
+        if (score < victimScore) {
+            victim = &entries[i];
+            victimScore = score;
+        }
+    }
+    __atomic_store_n(&victim->data, data, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->check, key ^ data, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sets up a search engine for one seat.
+ * @param engine - The engine to set up.
+ * @param seat - The player the engine moves for.
+ * @param table - Transposition table, which may be shared with other engines.
+ * @return void
+ */
+void initializeSearch(SearchEngine* engine, Outcome seat, SharedTable* table)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->seat = seat;
+    engine->table = table;
+    engine->seatKey = (uint64_t)seat * 0x9E3779B97F4A7C15ull;
+}
+
+/**
+ * Scores a non-terminal position for one seat.
+ * @param game - Pointer to the position.
+ * @param seat - The player the score is for.
+ * @return int - Positive when the position favours the seat.
+ * @details Uno and Tres gain from patterns their opponent has not blocked
+ *          (squared piece counts, from the sets' pattern counters); Dos gains
+ *          from a fuller board. The seat is compared with its best rival.
+ */
+int evaluatePosition(GameState* game, Outcome seat)
+{
+    int scores[4] = {0};
+    
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        int uno = game->Uno.patternCounts[p], tres = game->Tres.patternCounts[p];
+        if (tres == 0) {
+            scores[OUTCOME_UNO] += uno * uno;
+        }
+        if (uno == 0) {
+            scores[OUTCOME_TRES] += tres * tres;
+        }
+    }
+    scores[OUTCOME_DOS] = MAX_POSITIONS - setSize(game->F);
+    
+    int rival = 0;
+    for (Outcome player = OUTCOME_UNO; player <= OUTCOME_DOS; player++) {
+        if (player != seat && scores[player] > rival) {
+            rival = scores[player];
+        }
+    }
+    return 10 * (scores[seat] - rival);
+}
+
+/**
+ * Searches a position to a fixed depth.
+ * @param engine - The engine.
+ * @param game - Pointer to the position.
+ * @param depth - Remaining depth in plies.
+ * @param alpha - Lower end of the window, for the side to move.
+ * @param beta - Upper end of the window, for the side to move.
+ * @param ply - Distance from the root.
+ * @return int - Value of the position for the side to move (the seat's side or the other).
+ */
+int searchPosition(SearchEngine* engine, GameState* game, int depth, int alpha, int beta, int ply)
+{
+    bool seatToMove = phasePlayer(gamePhase(game)) == engine->seat;
+    
+    if ((++engine->nodes & 255) == 0
+        && (wallSeconds() > engine->deadline
+            || (engine->stopAll != NULL && __atomic_load_n(engine->stopAll, __ATOMIC_RELAXED)))) {
+        engine->stopped = true;
+    }
+    if (engine->stopped) {
+        return 0;
+    }
+    if (game->over) {
+        // Faster wins and slower losses score better; a draw by the draw rule scores 0
+        if (gameWinner(game) == OUTCOME_NONE) {
+            return 0;
+        }
+        bool seatWon = gameWinner(game) == engine->seat;
+        return seatWon == seatToMove ? SCORE_WIN - ply : ply - SCORE_WIN;
+    }
+    
+    uint64_t key = positionKey(game) ^ engine->seatKey;
+    if (depth <= 0 || ply >= SEARCH_MAX_PLY) {
+        int score = evaluatePosition(game, engine->seat);
+        return seatToMove ? score : -score;
+    }
+    
+    uint64_t entry;
+    int tableMove = -1;
+    if (probeSharedTable(engine->table, key, &entry)) {
+        tableMove = ENTRY_MOVE(entry);
+        if (ENTRY_DEPTH(entry) >= depth && ply > 0) {
+            int value = ENTRY_VALUE(entry), bound = ENTRY_BOUND(entry);
+            value += value > SCORE_WIN - 1000 ? -ply : value < 1000 - SCORE_WIN ? ply : 0;
+            if (bound == BOUND_EXACT
+                || (bound == BOUND_LOWER && value >= beta)
+                || (bound == BOUND_UPPER && value <= alpha)) {
+                return value;
+            }
+        }
+    }
+    
+    Position moves[MAX_POSITIONS];
+    int count = legalMoves(game, moves);
+    for (int i = 1; i < count; i++) {
+        if (positionToCell(moves[i]) == tableMove) {
+            Position first = moves[0];
+            moves[0] = moves[i];
+            moves[i] = first;
+        }
+    }
+    
+    int originalAlpha = alpha, best = -SCORE_INFINITE, bestMove = -1;
+    for (int i = 0; i < count && alpha < beta; i++) {
+        GameState child = *game;
+        playMove(&child, moves[i]);
+        
+        bool sameSide = (phasePlayer(gamePhase(&child)) == engine->seat) == seatToMove;
+        int value = sameSide ? searchPosition(engine, &child, depth - 1, alpha, beta, ply + 1)
+                             : -searchPosition(engine, &child, depth - 1, -beta, -alpha, ply + 1);
+        if (engine->stopped) {
+            return 0;
+        }
+        if (value > best) {
+            best = value;
+            bestMove = positionToCell(moves[i]);
+            if (value > alpha) {
+                alpha = value;
+            }
+        }
+    }
+    
+    // Store win/loss scores relative to this node so they stay valid at other depths
+    int stored = best + (best > SCORE_WIN - 1000 ? ply : best < 1000 - SCORE_WIN ? -ply : 0);
+    int bound = best <= originalAlpha ? BOUND_UPPER : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+    storeSharedTable(engine->table, key,
+                     packTableData(stored, depth, bound, bestMove, engine->table->generation));
+    if (ply == 0) {
+        engine->rootMove = bestMove;
+    }
+    return best;
+}
+
+/**
+ * Runs one helper thread of a Lazy SMP search.
+ * @param arg - Pointer to the thread's SearchHelper.
+ * @return void* - Always NULL.
+ * @details Iterates over depths like the main thread until the depth limit,
+ *          the deadline or the main thread's stop signal. Its only output is
+ *          what it leaves in the shared table.
+ */
+void* runSearchHelper(void* arg)
+{
+    SearchHelper* helper = arg;
+    
+    for (int depth = helper->firstDepth; depth <= helper->maxDepth && !helper->engine.stopped; depth++) {
+        searchPosition(&helper->engine, &helper->game, depth, -SCORE_INFINITE, SCORE_INFINITE, 0);
+    }
+    return NULL;
+}
+
+/**
+ * Picks a move for the engine's seat with iterative deepening.
+ * @param engine - The engine; its seat must be the player to move.
+ * @param game - Pointer to the current position.
+ * @param maxDepth - Deepest iteration to run.
+ * @param seconds - Time budget; the last finished iteration is used when it runs out.
+ * @param threads - Search threads, including the calling one (at most SEARCH_MAX_THREADS).
+ * @param move - Receives the chosen position.
+ * @return bool - false if there is no legal move.
+ * @details Helper threads start one ply deeper on every other thread so they
+ *          reach different parts of the tree first. Their node counts are
+ *          added to the engine's.
+ */
+bool searchBestMove(SearchEngine* engine, GameState* game, int maxDepth, double seconds, int threads, Position* move)
+{
+    Position moves[MAX_POSITIONS];
+    if (legalMoves(game, moves) == 0) {
+        return false;
+    }
+    if (maxDepth > SEARCH_MAX_PLY) {
+        maxDepth = SEARCH_MAX_PLY;
+    }
+    if (threads > SEARCH_MAX_THREADS) {
+        threads = SEARCH_MAX_THREADS;
+    }
+    
+    // Search a copy that does not write into the game's history
+    GameState root = *game;
+    root.history = NULL;
+    *move = moves[0];
+    engine->stopped = false;
+    engine->deadline = wallSeconds() + seconds;
+    engine->table->generation++;
+    
+    // Start the helpers, each with its own copy of the engine and the position
+    bool stopAll = false;
+    SearchHelper* helpers = threads > 1 ? calloc(threads, sizeof(SearchHelper)) : NULL;
+    pthread_t* ids = threads > 1 ? calloc(threads, sizeof(pthread_t)) : NULL;
+    int started = 1;
+    if (helpers != NULL && ids != NULL) {
+        for (; started < threads; started++) {
+            SearchHelper* helper = &helpers[started];
+            helper->engine = *engine;
+            helper->engine.nodes = 0;
+            helper->engine.stopAll = &stopAll;
+            helper->game = root;
+            helper->firstDepth = 1 + (started & 1);
+            helper->maxDepth = maxDepth;
+            if (pthread_create(&ids[started], NULL, runSearchHelper, helper) != 0) {
+                break;
+            }
+        }
+    }
+    
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        int value = searchPosition(engine, &root, depth, -SCORE_INFINITE, SCORE_INFINITE, 0);
+        if (engine->stopped) {
+            break;
+        }
+        *move = cellToPosition(engine->rootMove);
+        if (value > SCORE_WIN - 1000 || value < 1000 - SCORE_WIN) {
+            break;
+        }
+    }
+    
+    __atomic_store_n(&stopAll, true, __ATOMIC_RELAXED);
+    for (int i = 1; i < started; i++) {
+        pthread_join(ids[i], NULL);
+        engine->nodes += helpers[i].engine.nodes;
+    }
+    free(helpers);
+    free(ids);
+    return true;
+}
+
+/**
+ * Plays games with the engine in every seat and reports move selection speed.
+ * @param games - Number of games to play.
+ * @param seconds - Time budget per move.
+ * @param threads - Search threads per move.
+ * @param tableMegabytes - Size of the transposition table the seats share.
+ * @return int - Process exit code.
+ * @details Games still running after 300 moves are counted as unfinished.
+ */
+int runSearchBenchmark(int games, double seconds, int threads, size_t tableMegabytes)
+{
+    SharedTable table;
+    SearchEngine engines[4];
+    uint64_t moves = 0, nodes = 0, totals[4] = {0};
+    
+    if (!initializeSharedTable(&table, tableMegabytes)) {
+        fprintf(stderr, "Not enough memory for the transposition table.\n");
+        return 1;
+    }
+    for (int player = OUTCOME_UNO; player <= OUTCOME_DOS; player++) {
+        initializeSearch(&engines[player], (Outcome)player, &table);
+    }
+    const char* backings[3] = {"ordinary pages", "transparent huge pages", "huge pages"};
+    printf("Table: %zu KB on %s, %d thread%s\n", table.bytes >> 10, backings[table.backing],
+           threads, threads == 1 ? "" : "s");
+    
+    double start = wallSeconds();
+    for (int g = 0; g < games; g++) {
+        GameState game;
+        initializeGame(&game);
+        for (int ply = 0; ply < 300 && !game.over; ply++) {
+            SearchEngine* engine = &engines[phasePlayer(gamePhase(&game))];
+            Position move;
+            engine->nodes = 0;
+            searchBestMove(engine, &game, SEARCH_MAX_PLY, seconds, threads, &move);
+            playMove(&game, move);
+            nodes += engine->nodes;
+            moves++;
+        }
+        totals[gameWinner(&game)]++;
+    }
+    double elapsed = wallSeconds() - start;
+    
+    printf("Games: %d  Uno: %llu  Tres: %llu  Dos: %llu  Unfinished: %llu\n", games,
+           (unsigned long long)totals[OUTCOME_UNO], (unsigned long long)totals[OUTCOME_TRES],
+           (unsigned long long)totals[OUTCOME_DOS], (unsigned long long)totals[OUTCOME_NONE]);
+    printf("%llu moves, %.3f ms per move, %.0f nodes/s\n", (unsigned long long)moves,
+           moves ? elapsed * 1000 / moves : 0.0, elapsed > 0 ? nodes / elapsed : 0.0);
+    
+    freeSharedTable(&table);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Monte Carlo tree search player
+ *
+ * An alternative to the alpha-beta engine that needs neither an evaluation
+ * function nor solved tables, so it carries over to variants too large to
+ * solve. Each playout walks down the tree with UCT, expands the leaf it
+ * reaches, finishes the game with random moves (playMove, so nextPlayerMove
+ * and checkGameOver) and credits every node on the path with the result for
+ * the player who moved into it: 1 for a win, 0 for a loss and a third each
+ * when the game is abandoned after PLAYOUT_MAX_PLIES moves. Three players are
+ * handled by keeping each node's reward from its own mover's point of view.
+ *
+ * Nodes are 16 bytes and come from an arena that is emptied before every
+ * move, so the search never calls malloc. When the arena is full, playouts
+ * continue from the leaves without expanding them. The move played is the
+ * root child with the most visits.
+ *
+ * Several threads search with root parallelism: each grows its own tree in
+ * its own arena with its own random numbers, and the root visit counts are
+ * summed per move at the end. The trees share nothing while they grow, so
+ * there are no locks, atomics or virtual losses, and the playout rate scales
+ * with the cores. A playout budget is split evenly between the threads, which
+ * keeps the total work the same as a single-threaded search.
+ * ------------------------------------------------------------------------ */
+
+#define MCTS_EXPLORATION 1.0f
+
+/**
+ * Sets up a Monte Carlo search player.
+ * @param player - The player to set up.
+ * @param megabytes - Size of the node arena.
+ * @param seed - Seed of the playout random number generator.
+ * @return bool - false if the arena could not be allocated.
+ */
+bool initializeMcts(MctsPlayer* player, size_t megabytes, uint64_t seed)
+{
+    memset(player, 0, sizeof(*player));
+    size_t capacity = (megabytes << 20) / sizeof(MctsNode);
+    player->capacity = capacity > UINT32_MAX ? UINT32_MAX : (uint32_t)capacity;
+    player->nodes = malloc((size_t)player->capacity * sizeof(MctsNode));
+    seedRandom(&player->rng, seed);
+    return player->nodes != NULL && player->capacity > 1;
+}
+
+/**
+ * Releases a Monte Carlo search player's arena.
+ * @param player - The player.
+ * @return void
+ */
+void freeMcts(MctsPlayer* player)
+{
+    free(player->nodes);
+    player->nodes = NULL;
+}
+
+/**
+ * Takes a run of zeroed nodes from the arena.
+ * @param player - The player owning the arena.
+ * @param count - Number of nodes.
+ * @return uint32_t - Index of the first node, or 0 if the arena is full.
+ */
+uint32_t allocateMctsNodes(MctsPlayer* player, int count)
+{
+    if (player->capacity - player->used < (uint32_t)count) {
+        return 0;
+    }
+    uint32_t first = player->used;
+    player->used += count;
+    memset(&player->nodes[first], 0, count * sizeof(MctsNode));
+    return first;
+}
+
+/**
+ * Runs one playout from the root: selection, expansion, rollout and backup.
+ * @param player - The player; node 0 of its arena is the root.
+ * @param root - Pointer to the position at the root.
+ * @return void
+ */
+void runMctsPlayout(MctsPlayer* player, GameState* root)
+{
+    MctsNode* nodes = player->nodes;
+    uint32_t path[MCTS_MAX_DEPTH + 1];
+    Outcome movers[MCTS_MAX_DEPTH + 1];
+    GameState game = *root;
+    int depth = 0;
+    game.history = NULL;
+    uint32_t current = 0;
+    
+    path[0] = 0;
+    movers[0] = OUTCOME_NONE;
+    while (!game.over && depth < MCTS_MAX_DEPTH) {
+        MctsNode* node = &nodes[current];
+        
+        // Expand a leaf the first time a playout passes through it
+        if (node->firstChild == 0) {
+            Position moves[MAX_POSITIONS];
+            int count = legalMoves(&game, moves);
+            uint32_t first = node->visits > 0 || current == 0 ? allocateMctsNodes(player, count) : 0;
+            if (first == 0) {
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                nodes[first + i].cell = (int8_t)positionToCell(moves[i]);
+            }
+            node->firstChild = first;
+            node->childCount = (uint8_t)count;
+        }
+        
+        // UCT: mean reward for the mover plus an exploration bonus; unvisited children first
+        uint32_t best = node->firstChild;
+        float bestScore = -1.0f;
+        float exploration = MCTS_EXPLORATION * sqrtf(logf((float)node->visits + 1.0f));
+        for (uint32_t child = node->firstChild; child < node->firstChild + node->childCount; child++) {
+            if (nodes[child].visits == 0) {
+                best = child;
+                break;
+            }
+            float visits = (float)nodes[child].visits;
+            float score = nodes[child].reward / visits + exploration / sqrtf(visits);
+            if (score > bestScore) {
+                best = child;
+                bestScore = score;
+            }
+        }
+        
+        movers[depth + 1] = phasePlayer(gamePhase(&game));
+        playMove(&game, cellToPosition(nodes[best].cell));
+        path[++depth] = best;
+        current = best;
+        if (nodes[best].visits == 0) {
+            break;
+        }
+    }
+    
+    Outcome winner = playRandomGame(&game, &player->rng, PLAYOUT_MAX_PLIES);
+    for (int i = 0; i <= depth; i++) {
+        MctsNode* node = &nodes[path[i]];
+        node->visits++;
+        node->reward += winner == OUTCOME_NONE ? 1.0f / 3 : winner == movers[i] ? 1.0f : 0.0f;
+    }
+    player->playouts++;
+}
+
+/**
+ * Grows a player's tree for one position.
+ * @param player - The player; its arena is emptied first.
+ * @param game - Pointer to the position at the root.
+ * @param playouts - Playout budget, or 0 for no limit.
+ * @param seconds - Time budget, or 0 for no limit.
+ * @return void
+ * @details With neither budget set the tree gets a single playout rather
+ *          than growing forever.
+ */
+void growMctsTree(MctsPlayer* player, GameState* game, uint64_t playouts, double seconds)
+{
+    if (playouts == 0 && seconds <= 0) {
+        playouts = 1;
+    }
+    player->used = 0;
+    player->playouts = 0;
+    allocateMctsNodes(player, 1);
+    double deadline = wallSeconds() + seconds;
+    while ((playouts == 0 || player->playouts < playouts)
+           && (seconds <= 0 || (player->playouts & 63) != 0 || wallSeconds() < deadline)) {
+        runMctsPlayout(player, game);
+    }
+}
+
+/**
+ * Runs one thread of a root-parallel Monte Carlo search.
+ * @param arg - Pointer to the thread's MctsWorker.
+ * @return void* - Always NULL.
+ */
+void* runMctsWorker(void* arg)
+{
+    MctsWorker* worker = arg;
+    growMctsTree(worker->player, worker->game, worker->playouts, worker->seconds);
+    return NULL;
+}
+
+/**
+ * Picks a move with Monte Carlo tree search.
+ * @param players - One player per thread, each with its own arena and generator.
+ * @param threads - Number of threads, including the calling one (at most SEARCH_MAX_THREADS).
+ * @param game - Pointer to the current position.
+ * @param playouts - Total playout budget, or 0 for no limit.
+ * @param seconds - Time budget, or 0 for no limit (then playouts must be set).
+ * @param move - Receives the move with the most root visits over all trees.
+ * @return bool - false if there is no legal move.
+ */
+bool mctsBestMove(MctsPlayer* players, int threads, GameState* game, uint64_t playouts, double seconds, Position* move)
+{
+    Position moves[MAX_POSITIONS];
+    if (legalMoves(game, moves) == 0) {
+        return false;
+    }
+    
+    MctsWorker workers[SEARCH_MAX_THREADS];
+    pthread_t ids[SEARCH_MAX_THREADS];
+    bool started[SEARCH_MAX_THREADS] = {false};
+    threads = threads < 1 ? 1 : threads > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS : threads;
+    if (playouts > 0 && playouts < (uint64_t)threads) {
+        threads = (int)playouts;
+    }
+    for (int i = 0; i < threads; i++) {
+        uint64_t share = playouts == 0 ? 0 : playouts / threads + ((uint64_t)i < playouts % threads);
+        workers[i] = (MctsWorker){&players[i], game, share, seconds};
+    }
+    
+    // Thread 0 is the caller; a thread that fails to start leaves its share undone
+    for (int i = 1; i < threads; i++) {
+        started[i] = pthread_create(&ids[i], NULL, runMctsWorker, &workers[i]) == 0;
+    }
+    runMctsWorker(&workers[0]);
+    started[0] = true;
+    for (int i = 1; i < threads; i++) {
+        if (started[i]) {
+            pthread_join(ids[i], NULL);
+        }
+    }
+    
+    // Sum the root visits of each move over the trees
+    uint64_t visits[MAX_POSITIONS] = {0};
+    for (int i = 0; i < threads; i++) {
+        if (!started[i]) {
+            continue;
+        }
+        MctsNode* nodes = players[i].nodes;
+        for (uint32_t child = nodes[0].firstChild; child < nodes[0].firstChild + nodes[0].childCount; child++) {
+            visits[nodes[child].cell] += nodes[child].visits;
+        }
+    }
+    int best = positionToCell(moves[0]);
+    for (int cell = 0; cell < MAX_POSITIONS; cell++) {
+        if (visits[cell] > visits[best]) {
+            best = cell;
+        }
+    }
+    *move = cellToPosition(best);
+    return true;
+}
+
+/**
+ * Plays games with the Monte Carlo player in every seat and reports playout speed.
+ * @param games - Number of games to play.
+ * @param playouts - Playout budget per move, or 0 to use the time budget only.
+ * @param seconds - Time budget per move, or 0 to use the playout budget only.
+ * @param threads - Search threads per move (at most SEARCH_MAX_THREADS).
+ * @return int - Process exit code.
+ * @details Games still running after 300 moves are counted as unfinished.
+ */
+int runMctsBenchmark(int games, uint64_t playouts, double seconds, int threads)
+{
+    MctsPlayer players[SEARCH_MAX_THREADS];
+    uint64_t moves = 0, total = 0, totals[4] = {0};
+    
+    threads = threads < 1 ? 1 : threads > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS : threads;
+    for (int i = 0; i < threads; i++) {
+        if (!initializeMcts(&players[i], 64, 1 + i)) {
+            fprintf(stderr, "Not enough memory for the search trees.\n");
+            return 1;
+        }
+    }
+    
+    double start = wallSeconds();
+    for (int g = 0; g < games; g++) {
+        GameState game;
+        initializeGame(&game);
+        for (int ply = 0; ply < 300 && !game.over; ply++) {
+            Position move;
+            mctsBestMove(players, threads, &game, playouts, seconds, &move);
+            playMove(&game, move);
+            for (int i = 0; i < threads; i++) {
+                total += players[i].playouts;
+            }
+            moves++;
+        }
+        totals[gameWinner(&game)]++;
+    }
+    double elapsed = wallSeconds() - start;
+    
+    printf("Games: %d  Uno: %llu  Tres: %llu  Dos: %llu  Unfinished: %llu\n", games,
+           (unsigned long long)totals[OUTCOME_UNO], (unsigned long long)totals[OUTCOME_TRES],
+           (unsigned long long)totals[OUTCOME_DOS], (unsigned long long)totals[OUTCOME_NONE]);
+    printf("%llu moves, %.3f ms per move, %.0f playouts/s\n", (unsigned long long)moves,
+           moves ? elapsed * 1000 / moves : 0.0, elapsed > 0 ? total / elapsed : 0.0);
+    
+    for (int i = 0; i < threads; i++) {
+        freeMcts(&players[i]);
+    }
+    return 0;
+}
+
+/**
+ * Measures how parallel Monte Carlo search scales and whether it plays as well.
+ * @param positions - Number of test positions.
+ * @param playouts - Total playout budget per move, the same for every thread count.
+ * @param maxThreads - Largest thread count; counts double from 1 up to it.
+ * @param tablebasePath - Outcome tablebase, or NULL.
+ * @return int - Process exit code.
+ * @details Test positions come from random play from the start. With a
+ *          tablebase they are positions the player to move can force a win
+ *          from, and quality is the share of chosen moves that keep the win;
+ *          without one it is the share of moves that match the single-threaded
+ *          choice. Each thread count reports playouts per second and its
+ *          speed-up over one thread.
+ */
+int runMctsScaling(int positions, uint64_t playouts, int maxThreads, const char* tablebasePath)
+{
+    Tablebase tablebase;
+    MctsPlayer players[SEARCH_MAX_THREADS];
+    Rng rng;
+    
+    if (tablebasePath != NULL && !openTablebase(&tablebase, tablebasePath)) {
+        fprintf(stderr, "%s is missing or was built for a different grid or patterns.\n", tablebasePath);
+        return 1;
+    }
+    maxThreads = maxThreads < 1 ? 1 : maxThreads > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS : maxThreads;
+    GameState* games = malloc(positions * sizeof(GameState));
+    Position* baseline = malloc(positions * sizeof(Position));
+    if (games == NULL || baseline == NULL) {
+        fprintf(stderr, "Not enough memory for the test positions.\n");
+        return 1;
+    }
+    for (int i = 0; i < maxThreads; i++) {
+        if (!initializeMcts(&players[i], 64, 1 + i)) {
+            fprintf(stderr, "Not enough memory for the search trees.\n");
+            return 1;
+        }
+    }
+    
+    // Random positions, kept only if the mover can force a win when a tablebase is given
+    seedRandom(&rng, 2024);
+    for (int i = 0; i < positions; ) {
+        GameState* game = &games[i];
+        initializeGame(game);
+        playRandomGame(game, &rng, (int)randomBelow(&rng, 60));
+        if (!game->over && (tablebasePath == NULL
+            || probeTablebase(&tablebase, gameStateIndex(game)) == phasePlayer(gamePhase(game)))) {
+            i++;
+        }
+    }
+    
+    double baseRate = 0;
+    printf("Threads   Playouts/s  Speed-up  %s\n", tablebasePath ? "Wins kept" : "Same move as 1 thread");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        uint64_t total = 0;
+        int good = 0;
+        double start = wallSeconds();
+        for (int i = 0; i < positions; i++) {
+            Position move;
+            mctsBestMove(players, threads, &games[i], playouts, 0, &move);
+            for (int t = 0; t < threads; t++) {
+                total += players[t].playouts;
+            }
+            
+            if (tablebasePath != NULL) {
+                GameState child = games[i];
+                playMove(&child, move);
+                good += gameWinner(&child) == phasePlayer(gamePhase(&games[i]))
+                     || probeTablebase(&tablebase, gameStateIndex(&child)) == phasePlayer(gamePhase(&games[i]));
+            } else {
+                if (threads == 1) {
+                    baseline[i] = move;
+                }
+                good += move.x == baseline[i].x && move.y == baseline[i].y;
+            }
+        }
+        double rate = total / (wallSeconds() - start);
+        if (threads == 1) {
+            baseRate = rate;
+        }
+        printf("%7d  %11.0f  %7.2fx  %5.1f%%\n", threads, rate, rate / baseRate, 100.0 * good / positions);
+    }
+    
+    for (int i = 0; i < maxThreads; i++) {
+        freeMcts(&players[i]);
+    }
+    free(games);
+    free(baseline);
+    if (tablebasePath != NULL) {
+        closeTablebase(&tablebase);
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Self-play simulator
+ *
+ * Estimates the balance between the players by playing many games with
+ * random or simple heuristic moves through playMove. Games are dealt out in
+ * chunks of SIMULATION_CHUNK and end at the draw rule's move cap if they
+ * have not ended before; each chunk has its own generator seeded from
+ * the run's seed and the chunk number, so a run's results depend only on the
+ * seed and the game count, never on the number of threads or on which thread
+ * played which chunk. Threads claim chunks with an atomic counter, count
+ * results in their own stack copy of the statistics, and hand them over once
+ * at the end, so nothing is locked or shared while games are played.
+ *
+ * Unwatched runs play on the board kernel of the chosen size (see the board
+ * size kernels section), which on 4x4 plays the very games playMove would.
+ *
+ * With a monitor, each thread also stores its current game in one of the
+ * boards it owns after every move, as a single packed word (see the
+ * simulation monitor section), while the main thread draws the boards.
+ * ------------------------------------------------------------------------ */
+
+#define SIMULATION_CHUNK 4096
+
+/**
+ * Picks a move by simple rules, falling back to a random move.
+ * @param game - Pointer to the current game state.
+ * @param rng - The generator.
+ * @return int - The cell of the move, or -1 if there is none.
+ * @details Uno and Tres complete a pattern of their own if they can, and
+ *          otherwise block a pattern the other placer is one piece short of.
+ *          Dos removes a piece from a pattern that is one piece short.
+ */
+int heuristicMoveCell(GameState* game, Rng* rng)
+{
+    if (game->over) {
+        return -1;
+    }
+    
+    SetMask uno = setToMask(game->Uno), tres = setToMask(game->Tres), empty = setToMask(game->F);
+    Phase phase = gamePhase(game);
+    SetMask own = phase == PHASE_UNO ? uno : tres, other = phase == PHASE_UNO ? tres : uno;
+    int block = -1;
+    
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        SetMask pattern = winningMasks[p];
+        if (phase == PHASE_DOS) {
+            if (__builtin_popcount(pattern & uno) == PATTERN_LENGTH - 1) {
+                return __builtin_ctz(pattern & uno);
+            }
+            if (__builtin_popcount(pattern & tres) == PATTERN_LENGTH - 1) {
+                return __builtin_ctz(pattern & tres);
+            }
+            continue;
+        }
+        if (__builtin_popcount(pattern & own) == PATTERN_LENGTH - 1 && (pattern & empty)) {
+            return __builtin_ctz(pattern & empty);
+        }
+        if (__builtin_popcount(pattern & other) == PATTERN_LENGTH - 1 && (pattern & empty)) {
+            block = __builtin_ctz(pattern & empty);
+        }
+    }
+    return block >= 0 ? block : randomMoveCell(game, rng);
+}
+
+/**
+ * Plays chunks of simulated games until none are left.
+ * @param arg - Pointer to the thread's SimulationWorker.
+ * @return void* - Always NULL.
+ */
+void* runSimulationWorker(void* arg)
+{
+    SimulationWorker* worker = arg;
+    SimulationMonitor* monitor = worker->monitor;
+    SimulationStats stats;
+    memset(&stats, 0, sizeof(stats));
+    
+    // Boards owned by this thread, which take its games in turn
+    int owned = monitor != NULL && worker->thread < monitor->boards
+              ? (monitor->boards - worker->thread + monitor->threads - 1) / monitor->threads : 0;
+    uint64_t played = 0;
+    
+    uint64_t chunk;
+    while ((chunk = __atomic_fetch_add(worker->nextChunk, 1, __ATOMIC_RELAXED)) * SIMULATION_CHUNK < worker->games) {
+        Rng rng;
+        seedRandom(&rng, worker->seed ^ (chunk * 0xD1B54A32D192ED03ull));
+        uint64_t last = (chunk + 1) * SIMULATION_CHUNK;
+        for (uint64_t g = chunk * SIMULATION_CHUNK; g < last && g < worker->games; g++) {
+            GameState game;
+            MonitorSlot* slot = owned > 0
+                              ? &monitor->slots[worker->thread + monitor->threads * (int)(played++ % owned)] : NULL;
+            initializeGame(&game);
+            while (!game.over) {
+                int cell = worker->heuristic ? heuristicMoveCell(&game, &rng) : randomMoveCell(&game, &rng);
+                playMove(&game, cellToPosition(cell));
+                if (slot != NULL) {
+                    __atomic_store_n(&slot->state, packMonitorState(&game), __ATOMIC_RELAXED);
+                }
+            }
+            stats.wins[gameWinner(&game)]++;
+            stats.lengths[game.moveCount]++;
+            stats.moves += game.moveCount;
+        }
+        if (monitor != NULL) {
+            uint64_t done = (last < worker->games ? last : worker->games) - chunk * SIMULATION_CHUNK;
+            __atomic_fetch_add(&monitor->gamesDone, done, __ATOMIC_RELEASE);
+        }
+    }
+    worker->stats = stats;
+    return NULL;
+}
+
+/**
+ * Plays simulated games on several threads and reports the results.
+ * @param games - Number of games.
+ * @param threadCount - Number of threads.
+ * @param seed - Seed of the run; equal seeds give equal results.
+ * @param heuristic - Use heuristicMoveCell instead of uniformly random moves.
+ * @param maxPlies - Move cap, applied as the draw rule's; drawn games are counted separately.
+ * @param boards - Number of games to watch live with the monitor, or 0 for none.
+ * @param size - Width of the board; sizes other than GRID_SIZE cannot be watched.
+ * @return int - Process exit code.
+ * @details Prints win rates, the move-cap rate, throughput and a histogram
+ *          of game lengths in buckets of ten moves.
+ */
+int runSimulation(uint64_t games, int threadCount, uint64_t seed, bool heuristic, int maxPlies, int boards, int size)
+{
+    const BoardKernel* kernel = boardKernel(size);
+    if (kernel == NULL) {
+        fprintf(stderr, "Boards can be %dx%d to %dx%d.\n", BOARD_MIN_SIZE, BOARD_MIN_SIZE, BOARD_MAX_SIZE, BOARD_MAX_SIZE);
+        return 1;
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    if (maxPlies < 1 || maxPlies > SIMULATION_MAX_PLIES) {
+        maxPlies = SIMULATION_MAX_PLIES;
+    }
+    drawRule.maxMoves = maxPlies;
+    
+    SimulationWorker* workers = calloc(threadCount, sizeof(SimulationWorker));
+    pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        fprintf(stderr, "Not enough memory for the simulator threads.\n");
+        free(workers);
+        free(threads);
+        return 1;
+    }
+    
+    // The monitor needs ANSI cursor movement, which Windows consoles only have on request
+    #ifdef _WIN32
+        boards = 0;
+    #endif
+    if (size != GRID_SIZE) {
+        boards = 0;
+    }
+    SimulationMonitor* monitor = NULL;
+    if (boards > 0) {
+        monitor = calloc(1, sizeof(SimulationMonitor));
+        if (monitor == NULL) {
+            fprintf(stderr, "Not enough memory for the monitor.\n");
+            free(workers);
+            free(threads);
+            return 1;
+        }
+        // Only as many boards as the terminal can show are watched
+        int fit = monitorLayout(NULL);
+        boards = boards < fit ? boards : fit;
+        monitor->boards = boards < MONITOR_MAX_BOARDS ? boards : MONITOR_MAX_BOARDS;
+        monitor->threads = threadCount;
+    }
+    
+    // The board kernel plays the same games faster, but only GameState games can be watched
+    void* (*simulate)(void*) = monitor != NULL ? runSimulationWorker : kernel->simulate;
+    uint64_t nextChunk = 0;
+    double start = wallSeconds();
+    int started = 0;
+    for (; started < threadCount; started++) {
+        workers[started] = (SimulationWorker){.nextChunk = &nextChunk, .games = games, .seed = seed,
+                                              .heuristic = heuristic, .monitor = monitor, .thread = started};
+        if (pthread_create(&threads[started], NULL, simulate, &workers[started]) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        // Without threads to watch, play the games first and show where they ended
+        simulate(&workers[0]);
+    }
+    if (monitor != NULL) {
+        watchSimulation(monitor, games);
+    }
+    
+    SimulationStats total;
+    memset(&total, 0, sizeof(total));
+    for (int t = 0; t < (started > 0 ? started : 1); t++) {
+        if (started > 0) {
+            pthread_join(threads[t], NULL);
+        }
+        for (int o = 0; o < 4; o++) {
+            total.wins[o] += workers[t].stats.wins[o];
+        }
+        total.moves += workers[t].stats.moves;
+        for (int n = 0; n <= maxPlies; n++) {
+            total.lengths[n] += workers[t].stats.lengths[n];
+        }
+    }
+    double elapsed = wallSeconds() - start;
+    
+    double share = games ? 100.0 / games : 0.0;
+    printf("%llu %s games on %dx%d, seed %llu, %d thread%s, cap %d moves\n", (unsigned long long)games,
+           heuristic ? "heuristic" : "random", size, size, (unsigned long long)seed, started > 0 ? started : 1,
+           started > 1 ? "s" : "", maxPlies);
+    printf("Uno: %.2f%%  Tres: %.2f%%  Dos: %.2f%%  Move cap: %.2f%%\n", total.wins[OUTCOME_UNO] * share,
+           total.wins[OUTCOME_TRES] * share, total.wins[OUTCOME_DOS] * share, total.wins[OUTCOME_NONE] * share);
+    printf("%.1f moves per game, %.3f s, %.0f games/s, %.0f moves/s\n", games ? (double)total.moves / games : 0.0,
+           elapsed, elapsed > 0 ? games / elapsed : 0.0, elapsed > 0 ? total.moves / elapsed : 0.0);
+    
+    printf("\nMoves      Games   Share\n");
+    for (int low = 0; low <= maxPlies; low += 10) {
+        uint64_t count = 0;
+        for (int n = low; n < low + 10 && n <= maxPlies; n++) {
+            count += total.lengths[n];
+        }
+        if (count > 0) {
+            int bar = (int)(count * share / 2 + 0.5);
+            printf("%3d-%-3d %10llu  %5.2f%%  %.*s\n", low, low + 9, (unsigned long long)count, count * share,
+                   bar, "##################################################");
+        }
+    }
+    
+    free(workers);
+    free(threads);
+    free(monitor);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Perft
+ *
+ * Counts the move paths of a given length from a position, following the
+ * moves nextPlayerMove accepts and stopping at positions checkGameOver ends
+ * (a game that ends early contributes no longer paths). The counts pin down
+ * move generation, so any change to the sets, the move rules or the end
+ * checks that alters them shows up at once, and paths per second is a
+ * throughput figure that compares set backends and builds.
+ *
+ * The last ply is counted in bulk from the move mask without being played.
+ * Subtree counts can be cached in a SharedTable, keyed by the position key
+ * mixed with the remaining depth and stored with the same XOR validation as
+ * search entries. A count entry keeps the remaining depth and the generation
+ * where search entries do, so the table's replacement policy treats both
+ * alike; the count takes the value bits and the bits above the generation,
+ * and larger counts are not cached. Threads split the work at the root.
+ * ------------------------------------------------------------------------ */
+
+#define PERFT_DEPTH_KEY 0xA24BAED4963EE407ull
+#define PERFT_COUNT_LIMIT (1ull << 40)    // Counts from here on do not fit in an entry
+#define PERFT_ENTRY_COUNT(data) (((data) & 0xFFFF) | ((data) >> 40) << 16)
+
+/**
+ * Reads a position written as rows of cells and the player to move.
+ * @param text - Four rows of four cells ('U', 'T' or '.'), rows y = 1..4 from
+ *               left (x = 1) to right as the board is displayed, optionally
+ *               separated by '/', then a space and 't', 'u' or 'd' for the
+ *               player to move, e.g. "U.../.T../..../.... d".
+ * @param game - Receives the position.
+ * @return bool - false if the text is malformed.
+ */
+bool parsePosition(const char* text, GameState* game)
+{
+    SetMask uno = 0, tres = 0;
+    int cells = 0;
+    
+    for (; *text && *text != ' ' && cells <= MAX_POSITIONS; text++) {
+        if (*text == '/') {
+            continue;
+        }
+        Position pos = {cells % GRID_SIZE + 1, cells / GRID_SIZE + 1};
+        SetMask bit = (SetMask)(1u << positionToCell(pos));
+        if (*text == 'U' || *text == 'u') {
+            uno |= bit;
+        } else if (*text == 'T' || *text == 't') {
+            tres |= bit;
+        } else if (*text != '.') {
+            return false;
+        }
+        cells++;
+    }
+    while (*text == ' ') {
+        text++;
+    }
+    if (cells != MAX_POSITIONS || text[0] == '\0' || text[1] != '\0') {
+        return false;
+    }
+    
+    Phase phase;
+    if (text[0] == 't' || text[0] == 'T') {
+        phase = PHASE_TRES;
+    } else if (text[0] == 'u' || text[0] == 'U') {
+        phase = PHASE_UNO;
+    } else if (text[0] == 'd' || text[0] == 'D') {
+        phase = PHASE_DOS;
+    } else {
+        return false;
+    }
+    setGamePosition(game, uno, tres, phase);
+    return true;
+}
+
+/**
+ * Packs a subtree count into the data word of a table entry.
+ * @param count - Number of paths, below PERFT_COUNT_LIMIT.
+ * @param depth - Remaining depth (at least 2, so stored data is never zero).
+ * @param generation - The table's current generation.
+ * @return uint64_t - The data word; ENTRY_DEPTH, ENTRY_GENERATION and
+ *                    PERFT_ENTRY_COUNT read it back.
+ */
+uint64_t packPerftData(uint64_t count, int depth, uint8_t generation)
+{
+    return (count & 0xFFFF)
+         | (uint64_t)(depth & 0xFF) << 16
+         | (uint64_t)generation << 32
+         | (count >> 16) << 40;
+}
+
+/**
+ * Counts the move paths of a given length from a position.
+ * @param game - Pointer to the position.
+ * @param depth - Path length in moves.
+ * @param table - Cache of subtree counts, or NULL.
+ * @return uint64_t - Number of paths; 0 if the game ends before depth moves.
+ */
+uint64_t perft(GameState* game, int depth, SharedTable* table)
+{
+    if (depth == 0) {
+        return 1;
+    }
+    if (game->over) {
+        return 0;
+    }
+    
+    SetMask moves = game->turn ? setToMask(game->F)
+                               : (SetMask)(setToMask(game->Uno) | setToMask(game->Tres));
+    if (depth == 1) {
+        return __builtin_popcount(moves);
+    }
+    
+    uint64_t key = positionKey(game) ^ (uint64_t)depth * PERFT_DEPTH_KEY, count = 0, data;
+    if (table != NULL && probeSharedTable(table, key, &data)) {
+        return PERFT_ENTRY_COUNT(data);
+    }
+    for (; moves; moves &= moves - 1) {
+        GameState child = *game;
+        playMove(&child, cellToPosition(__builtin_ctz(moves)));
+        count += perft(&child, depth - 1, table);
+    }
+    if (table != NULL && count < PERFT_COUNT_LIMIT) {
+        storeSharedTable(table, key, packPerftData(count, depth, table->generation));
+    }
+    return count;
+}
+
+/**
+ * Counts paths below root moves until none are left unclaimed.
+ * @param arg - Pointer to the PerftRun.
+ * @return void* - Always NULL.
+ */
+void* runPerftWorker(void* arg)
+{
+    PerftRun* run = arg;
+    int i;
+    
+    while ((i = __atomic_fetch_add(&run->nextMove, 1, __ATOMIC_RELAXED)) < run->moveCount) {
+        GameState child = run->root;
+        playMove(&child, run->moves[i]);
+        run->counts[i] = perft(&child, run->depth - 1, run->table);
+    }
+    return NULL;
+}
+
+/**
+ * Runs perft and prints the paths below each root move and the total.
+ * @param depth - Path length in moves.
+ * @param threadCount - Number of threads.
+ * @param tableMegabytes - Size of the subtree count cache, or 0 for none.
+ * @param position - Start position for parsePosition, or NULL for the initial position.
+ * @param size - Width of the board; other sizes than GRID_SIZE start from the
+ *               empty board and run on their board kernel without a cache.
+ * @return int - Process exit code.
+ */
+int runPerft(int depth, int threadCount, size_t tableMegabytes, const char* position, int size)
+{
+    PerftRun run;
+    SharedTable table;
+    
+    if (size != GRID_SIZE) {
+        const BoardKernel* kernel = boardKernel(size);
+        if (kernel == NULL) {
+            fprintf(stderr, "Boards can be %dx%d to %dx%d.\n", BOARD_MIN_SIZE, BOARD_MIN_SIZE, BOARD_MAX_SIZE, BOARD_MAX_SIZE);
+            return 1;
+        }
+        if (position != NULL) {
+            fprintf(stderr, "Perft on boards other than %dx%d starts from the empty board.\n", GRID_SIZE, GRID_SIZE);
+            return 1;
+        }
+        return runBoardPerft(depth, threadCount, kernel);
+    }
+    memset(&run, 0, sizeof(run));
+    if (position == NULL) {
+        initializeGame(&run.root);
+    } else if (!parsePosition(position, &run.root)) {
+        fprintf(stderr, "Invalid position \"%s\".\n", position);
+        return 1;
+    }
+    if (tableMegabytes > 0 && !initializeSharedTable(&table, tableMegabytes)) {
+        fprintf(stderr, "Not enough memory for the perft table.\n");
+        return 1;
+    }
+    run.table = tableMegabytes > 0 ? &table : NULL;
+    run.depth = depth;
+    run.moveCount = depth > 0 ? legalMoves(&run.root, run.moves) : 0;
+    
+    double start = wallSeconds();
+    uint64_t total = depth == 0 ? 1 : 0;
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    // The calling thread is the first worker
+    pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+    int started = 1;
+    for (; threads != NULL && started < threadCount; started++) {
+        if (pthread_create(&threads[started], NULL, runPerftWorker, &run) != 0) {
+            break;
+        }
+    }
+    runPerftWorker(&run);
+    for (int t = 1; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = wallSeconds() - start;
+    
+    for (int i = 0; i < run.moveCount; i++) {
+        printf("[%d,%d]: %llu\n", run.moves[i].x, run.moves[i].y, (unsigned long long)run.counts[i]);
+        total += run.counts[i];
+    }
+    printf("Depth %d: %llu paths in %.3f s (%.0f paths/s, %d thread%s%s)\n", depth, (unsigned long long)total,
+           elapsed, elapsed > 0 ? total / elapsed : 0.0, started, started > 1 ? "s" : "",
+           run.table != NULL ? ", cached" : "");
+    
+    free(threads);
+    if (run.table != NULL) {
+        freeSharedTable(&table);
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Board size kernels
+ *
+ * The game, the solver and the file formats are built for GRID_SIZE, but
+ * the simulator and perft can also play 5x5 to 8x8 boards chosen at run
+ * time. The three winning patterns keep their shape on every size: the
+ * first line, the anti-diagonal and the last line, each as long as the
+ * board is wide, numbered the way positionToCell numbers cells.
+ *
+ * DEFINE_BOARD_KERNEL stamps out the move, game over, simulation and perft
+ * code once per size, with the width and the occupancy word as compile time
+ * constants: 16-bit masks for 4x4, 32-bit for 5x5 and 64-bit from 6x6 up.
+ * A kernel keeps nothing but the two masks and the phase, so no size carries
+ * the counters and keys of GameState, and boardKernels dispatches a size to
+ * its kernel. A kernel draws random numbers exactly as randomMoveCell and
+ * heuristicMoveCell do, so on 4x4 it plays the same games as the GameState
+ * code, in a little over half the time. Watched simulations and perft on
+ * 4x4 still go through GameState, which the monitor and the position cache
+ * need.
+ * ------------------------------------------------------------------------ */
+
+#define BOARD_FULL(N, MASK) ((MASK)(((uint64_t)1 << ((N) * (N) - 1) << 1) - 1))    // Every cell of an N x N board
+#define BOARD_POPCOUNT(mask) (sizeof(mask) <= 4 ? __builtin_popcount((uint32_t)(mask)) : __builtin_popcountll((uint64_t)(mask)))
+#define BOARD_CTZ(mask) (sizeof(mask) <= 4 ? __builtin_ctz((uint32_t)(mask)) : __builtin_ctzll((uint64_t)(mask)))
+
+// Winning patterns of every board size as occupancy masks, built by initializeBoardKernels
+uint64_t boardPatterns[BOARD_MAX_SIZE + 1][NUM_PATTERNS];
+
+/**
+ * Builds the winning pattern masks of every board size.
+ * @return void
+ */
+void initializeBoardKernels()
+{
+    for (int n = BOARD_MIN_SIZE; n <= BOARD_MAX_SIZE; n++) {
+        for (int i = 0; i < n; i++) {
+            boardPatterns[n][0] |= (uint64_t)1 << i;                          // x = 1
+            boardPatterns[n][1] |= (uint64_t)1 << (i * n + (n - 1 - i));      // x + y = n + 1
+            boardPatterns[n][2] |= (uint64_t)1 << ((n - 1) * n + i);          // x = n
+        }
+    }
+}
+
+/*
+ * Defines the kernel of an N x N board using MASK as its occupancy word:
+ * boardOutcomeN, boardMoveCellN, runBoardSimulationN and boardPerftN.
+ */
+#define DEFINE_BOARD_KERNEL(N, MASK)                                                                      \
+                                                                                                          \
+/* Applies the game over rules to a pair of masks, as maskOutcome does */                                 \
+Outcome boardOutcome##N(MASK uno, MASK tres)                                                              \
+{                                                                                                         \
+    for (int p = 0; p < NUM_PATTERNS; p++) {                                                              \
+        if ((uno & (MASK)boardPatterns[N][p]) == (MASK)boardPatterns[N][p]) {                             \
+            return OUTCOME_UNO;                                                                           \
+        }                                                                                                 \
+    }                                                                                                     \
+    for (int p = 0; p < NUM_PATTERNS; p++) {                                                              \
+        if ((tres & (MASK)boardPatterns[N][p]) == (MASK)boardPatterns[N][p]) {                            \
+            return OUTCOME_TRES;                                                                          \
+        }                                                                                                 \
+    }                                                                                                     \
+    return (MASK)(uno | tres) == BOARD_FULL(N, MASK) ? OUTCOME_DOS : OUTCOME_NONE;                        \
+}                                                                                                         \
+                                                                                                          \
+/* Picks a move the way heuristicMoveCell or randomMoveCell would */                                      \
+int boardMoveCell##N(MASK uno, MASK tres, Phase phase, bool heuristic, Rng* rng)                          \
+{                                                                                                         \
+    MASK empty = (MASK)(BOARD_FULL(N, MASK) & ~(uno | tres));                                             \
+    if (heuristic) {                                                                                      \
+        MASK own = phase == PHASE_UNO ? uno : tres, other = phase == PHASE_UNO ? tres : uno;              \
+        int block = -1;                                                                                   \
+        for (int p = 0; p < NUM_PATTERNS; p++) {                                                          \
+            MASK pattern = (MASK)boardPatterns[N][p];                                                     \
+            if (phase == PHASE_DOS) {                                                                     \
+                if (BOARD_POPCOUNT((MASK)(pattern & uno)) == N - 1) {                                     \
+                    return BOARD_CTZ((MASK)(pattern & uno));                                              \
+                }                                                                                         \
+                if (BOARD_POPCOUNT((MASK)(pattern & tres)) == N - 1) {                                    \
+                    return BOARD_CTZ((MASK)(pattern & tres));                                             \
+                }                                                                                         \
+                continue;                                                                                 \
+            }                                                                                             \
+            if (BOARD_POPCOUNT((MASK)(pattern & own)) == N - 1 && (pattern & empty)) {                    \
+                return BOARD_CTZ((MASK)(pattern & empty));                                                \
+            }                                                                                             \
+            if (BOARD_POPCOUNT((MASK)(pattern & other)) == N - 1 && (pattern & empty)) {                  \
+                block = BOARD_CTZ((MASK)(pattern & empty));                                               \
+            }                                                                                             \
+        }                                                                                                 \
+        if (block >= 0) {                                                                                 \
+            return block;                                                                                 \
+        }                                                                                                 \
+    }                                                                                                     \
+                                                                                                          \
+    MASK moves = phase == PHASE_DOS ? (MASK)(uno | tres) : empty;                                         \
+    if (moves == 0) {                                                                                     \
+        return -1;                                                                                        \
+    }                                                                                                     \
+    for (uint32_t skip = randomBelow(rng, BOARD_POPCOUNT(moves)); skip > 0; skip--) {                     \
+        moves &= moves - 1;                                                                               \
+    }                                                                                                     \
+    return BOARD_CTZ(moves);                                                                              \
+}                                                                                                         \
+                                                                                                          \
+/* Plays chunks of simulated games until none are left, as runSimulationWorker does */                    \
+void* runBoardSimulation##N(void* arg)                                                                    \
+{                                                                                                         \
+    SimulationWorker* worker = arg;                                                                       \
+    uint32_t maxMoves = drawRule.maxMoves > 0 ? (uint32_t)drawRule.maxMoves : UINT32_MAX;                 \
+    SimulationStats stats;                                                                                \
+    memset(&stats, 0, sizeof(stats));                                                                     \
+                                                                                                          \
+    uint64_t chunk;                                                                                       \
+    while ((chunk = __atomic_fetch_add(worker->nextChunk, 1, __ATOMIC_RELAXED)) * SIMULATION_CHUNK        \
+           < worker->games) {                                                                             \
+        Rng rng;                                                                                          \
+        seedRandom(&rng, worker->seed ^ (chunk * 0xD1B54A32D192ED03ull));                                 \
+        uint64_t last = (chunk + 1) * SIMULATION_CHUNK;                                                   \
+        for (uint64_t g = chunk * SIMULATION_CHUNK; g < last && g < worker->games; g++) {                 \
+            MASK uno = 0, tres = 0;                                                                       \
+            Phase phase = PHASE_TRES;                                                                     \
+            Outcome winner;                                                                               \
+            uint32_t moves = 0;                                                                           \
+            do {                                                                                          \
+                MASK bit = (MASK)((MASK)1 << boardMoveCell##N(uno, tres, phase, worker->heuristic, &rng)); \
+                if (phase == PHASE_TRES) {                                                                \
+                    tres |= bit;                                                                          \
+                    phase = PHASE_UNO;                                                                    \
+                } else if (phase == PHASE_UNO) {                                                          \
+                    uno |= bit;                                                                           \
+                    phase = PHASE_DOS;                                                                    \
+                } else {                                                                                  \
+                    uno &= (MASK)~bit;                                                                    \
+                    tres &= (MASK)~bit;                                                                   \
+                    phase = PHASE_TRES;                                                                   \
+                }                                                                                         \
+                moves++;                                                                                  \
+                winner = boardOutcome##N(uno, tres);                                                      \
+            } while (winner == OUTCOME_NONE && moves < maxMoves);                                         \
+            stats.wins[winner]++;                                                                         \
+            stats.lengths[moves]++;                                                                       \
+            stats.moves += moves;                                                                         \
+        }                                                                                                 \
+    }                                                                                                     \
+    worker->stats = stats;                                                                                \
+    return NULL;                                                                                          \
+}                                                                                                         \
+                                                                                                          \
+/* Counts the move paths of a given length from a position, as perft does */                              \
+uint64_t boardPerft##N(uint64_t unoBits, uint64_t tresBits, Phase phase, int depth)                      \
+{                                                                                                         \
+    MASK uno = (MASK)unoBits, tres = (MASK)tresBits;                                                      \
+    if (depth == 0) {                                                                                     \
+        return 1;                                                                                         \
+    }                                                                                                     \
+    if (boardOutcome##N(uno, tres) != OUTCOME_NONE) {                                                     \
+        return 0;                                                                                         \
+    }                                                                                                     \
+                                                                                                          \
+    MASK moves = phase == PHASE_DOS ? (MASK)(uno | tres) : (MASK)(BOARD_FULL(N, MASK) & ~(uno | tres));   \
+    if (depth == 1) {                                                                                     \
+        return BOARD_POPCOUNT(moves);                                                                     \
+    }                                                                                                     \
+    uint64_t count = 0;                                                                                   \
+    for (; moves; moves &= moves - 1) {                                                                   \
+        MASK bit = (MASK)(moves & (MASK)~(moves - 1));                                                    \
+        if (phase == PHASE_TRES) {                                                                        \
+            count += boardPerft##N(uno, tres | bit, PHASE_UNO, depth - 1);                                \
+        } else if (phase == PHASE_UNO) {                                                                  \
+            count += boardPerft##N(uno | bit, tres, PHASE_DOS, depth - 1);                                \
+        } else {                                                                                          \
+            count += boardPerft##N(uno & (MASK)~bit, tres & (MASK)~bit, PHASE_TRES, depth - 1);           \
+        }                                                                                                 \
+    }                                                                                                     \
+    return count;                                                                                         \
+}
+
+DEFINE_BOARD_KERNEL(4, uint16_t)
+DEFINE_BOARD_KERNEL(5, uint32_t)
+DEFINE_BOARD_KERNEL(6, uint64_t)
+DEFINE_BOARD_KERNEL(7, uint64_t)
+DEFINE_BOARD_KERNEL(8, uint64_t)
+
+// Kernels by board size
+BoardKernel boardKernels[BOARD_MAX_SIZE + 1] = {
+    [4] = {4, runBoardSimulation4, boardPerft4},
+    [5] = {5, runBoardSimulation5, boardPerft5},
+    [6] = {6, runBoardSimulation6, boardPerft6},
+    [7] = {7, runBoardSimulation7, boardPerft7},
+    [8] = {8, runBoardSimulation8, boardPerft8}
+};
+
+/**
+ * Looks up the kernel of a board size.
+ * @param size - Width of the board.
+ * @return const BoardKernel* - The kernel, or NULL if the size is not supported.
+ */
+const BoardKernel* boardKernel(int size)
+{
+    if (size < BOARD_MIN_SIZE || size > BOARD_MAX_SIZE) {
+        return NULL;
+    }
+    return &boardKernels[size];
+}
+
+/**
+ * Counts paths below root cells until none are left unclaimed.
+ * @param arg - Pointer to the BoardPerftRun.
+ * @return void* - Always NULL.
+ * @details Tres moves first, so every cell of the empty board is a root move.
+ */
+void* runBoardPerftWorker(void* arg)
+{
+    BoardPerftRun* run = arg;
+    int cell;
+    
+    while ((cell = __atomic_fetch_add(&run->nextCell, 1, __ATOMIC_RELAXED)) < run->cellCount) {
+        run->counts[cell] = run->kernel->perft(0, (uint64_t)1 << cell, PHASE_UNO, run->depth - 1);
+    }
+    return NULL;
+}
+
+/**
+ * Runs perft from the empty board of a kernel's size.
+ * @param depth - Path length in moves.
+ * @param threadCount - Number of threads.
+ * @param kernel - The board kernel.
+ * @return int - Process exit code.
+ * @details Prints the paths below each root move and the total, like runPerft.
+ */
+int runBoardPerft(int depth, int threadCount, const BoardKernel* kernel)
+{
+    BoardPerftRun run;
+    
+    memset(&run, 0, sizeof(run));
+    run.kernel = kernel;
+    run.depth = depth;
+    run.cellCount = depth > 0 ? kernel->size * kernel->size : 0;
+    
+    double start = wallSeconds();
+    uint64_t total = depth == 0 ? 1 : 0;
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    // The calling thread is the first worker
+    pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+    int started = 1;
+    for (; threads != NULL && started < threadCount; started++) {
+        if (pthread_create(&threads[started], NULL, runBoardPerftWorker, &run) != 0) {
+            break;
+        }
+    }
+    runBoardPerftWorker(&run);
+    for (int t = 1; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = wallSeconds() - start;
+    
+    for (int cell = 0; cell < run.cellCount; cell++) {
+        printf("[%d,%d]: %llu\n", cell / kernel->size + 1, cell % kernel->size + 1, (unsigned long long)run.counts[cell]);
+        total += run.counts[cell];
+    }
+    printf("Depth %d on %dx%d: %llu paths in %.3f s (%.0f paths/s, %d thread%s)\n", depth, kernel->size, kernel->size,
+           (unsigned long long)total, elapsed, elapsed > 0 ? total / elapsed : 0.0, started, started > 1 ? "s" : "");
+    
+    free(threads);
+    return 0;
+}
+
+/**
+ * Clears the console screen.
+ * @return void
+ * @details Uses platform-specific commands to clear the terminal/console screen
+ *          (cls for Windows, clear for Unix-like systems).
+ */
+void clrscr()
+{
+    #ifdef _WIN32
+        system("cls");
+    #else
+        system("clear");
+    #endif
+}
+
+/* ------------------------------------------------------------------------
+ * Frame renderer
+ *
+ * displayGame used to clear the screen by running the clear command, which
+ * starts a shell, and then printed the board with dozens of small printf
+ * calls. It now builds the whole frame - the clear sequence, the grid, the
+ * status and the move list - in a preallocated buffer and hands it to the
+ * terminal with a single write, which matters on remote terminals where
+ * each flush costs a round trip. Windows consoles keep cls, since they only
+ * understand the ANSI sequences once virtual terminal mode is switched on.
+ *
+ * The differential renderer goes further and sends only what changed since
+ * the last frame: a BoardView remembers the cells and status lines it drew
+ * at a given origin, and later frames move the cursor to each changed cell
+ * or line and overwrite it, padding with spaces where the new text is
+ * narrower. A move changes one cell and a few lines, so a frame shrinks to
+ * a small fraction of a full redraw, and boards at different origins can
+ * share a screen without erasing each other.
+ * ------------------------------------------------------------------------ */
+
+#define FRAME_CLEAR "\033[H\033[2J\033[3J"    // Cursor home, erase screen and scrollback
+
+#define VIEW_STATUS_ROW (3 + 2 * GRID_SIZE)    // First status line, counted from the view's row
+
+// Frame reused by displayGame, and the view it draws the game in
+FrameBuffer screenFrame;
+BoardView screenView;
+bool fullRedraw = false;    // Redraw the whole screen every frame instead of the changes
+
+/**
+ * Appends formatted text to a frame.
+ * @param frame - The frame.
+ * @param format - printf-style format, followed by its arguments.
+ * @return void
+ * @details Text that does not fit in FRAME_BUFFER_SIZE is cut off.
+ */
+void appendFrame(FrameBuffer* frame, const char* format, ...)
+{
+    va_list args;
+    size_t room = sizeof(frame->data) - frame->length;
+    
+    va_start(args, format);
+    int written = vsnprintf(frame->data + frame->length, room, format, args);
+    va_end(args);
+    if (written > 0) {
+        frame->length += (size_t)written < room ? (size_t)written : room - 1;
+    }
+}
+
+/**
+ * Builds the screen for a game state.
+ * @param frame - The frame; its previous contents are discarded.
+ * @param game - Pointer to the game state to show.
+ * @return void
+ * @details Renders the game grid showing player positions, the game status and
+ *          whose turn it is, and the available moves for the current player,
+ *          preceded by the sequence clearing the screen.
+ */
+void renderGame(FrameBuffer* frame, GameState* game)
+{
+    frame->length = 0;
+    #ifndef _WIN32
+        appendFrame(frame, FRAME_CLEAR);
+    #endif
+    
+    appendFrame(frame, "      GAME GRID\n\n");
+    
+    // Display coordinate reference above the board
+    appendFrame(frame, "    ");
+    for (int x = 1; x <= GRID_SIZE; x++) {
+        appendFrame(frame, "%d   ", x);
+    }
+    appendFrame(frame, "\n");
+    
+    // Display the board with simplified format
+    for (int y = 1; y <= GRID_SIZE; y++) {
+        appendFrame(frame, "%d  ", y);  // Row coordinate
+        
+        for (int x = 1; x <= GRID_SIZE; x++) {
+            Position currentPos = {x, y};
+            if (positionInSet(currentPos, game->Uno)) {
+                appendFrame(frame, "\033[1;95m[U]\033[0m ");
             }
-            else if (positionInSet(currentPos, game.Tres)) {
-                printf("\033[1;94m[T]\033[0m ");
+            else if (positionInSet(currentPos, game->Tres)) {
+                appendFrame(frame, "\033[1;94m[T]\033[0m ");
             }
             else {
-                printf("[ ] ");
+                appendFrame(frame, "[ ] ");
             }
         }
 
-        printf("\n\n");
+        appendFrame(frame, "\n\n");
     }
     
+    renderGameStatus(frame, game);
+}
+
+/**
+ * Appends the status and move list shown below the grid.
+ * @param frame - The frame.
+ * @param game - Pointer to the game state to show.
+ * @return void
+ */
+void renderGameStatus(FrameBuffer* frame, GameState* game)
+{
     // Display game status
-    printf("\nGame Status: ");
-    if (game.over) {
-        if (checkWinningPattern(game.Uno)) {
-            printf("Game Over - Uno Wins!\n");
+    appendFrame(frame, "\nGame Status: ");
+    if (game->over) {
+        if (checkWinningPattern(game->Uno)) {
+            appendFrame(frame, "Game Over - Uno Wins!\n");
         }
-        else if (checkWinningPattern(game.Tres)) {
-            printf("Game Over - Tres Wins!\n");
+        else if (checkWinningPattern(game->Tres)) {
+            appendFrame(frame, "Game Over - Tres Wins!\n");
         }
-        else if (game.F.size == 0) {
-            printf("Game Over - Dos Wins!\n");
+        else if (setSize(game->F) == 0) {
+            appendFrame(frame, "Game Over - Dos Wins!\n");
+        }
+        else {
+            appendFrame(frame, "Game Over - Draw!\n");
         }
     } else {
-        if (game.turn && game.go) {
-            printf("\033[1;95mUno's Turn (Place a piece)\033[0m\n");
+        if (game->turn && game->go) {
+            appendFrame(frame, "\033[1;95mUno's Turn (Place a piece)\033[0m\n");
         }
-        else if (game.turn && !game.go) {
-            printf("\033[1;94mTres's Turn (Place a piece)\033[0m\n");
+        else if (game->turn && !game->go) {
+            appendFrame(frame, "\033[1;94mTres's Turn (Place a piece)\033[0m\n");
         }
         else {
-            printf("\033[1;91mDos' Turn (Remove a U or T piece)\033[0m\n");
+            appendFrame(frame, "\033[1;91mDos' Turn (Remove a U or T piece)\033[0m\n");
+        }
+        
+        // Show the solved outcome when a tablebase is loaded
+        if (loadedTablebase != NULL) {
+            const char* names[4] = {"no one can force a win", "Uno can force a win",
+                                    "Tres can force a win", "Dos can force a win"};
+            appendFrame(frame, "Best play: %s\n", names[probeTablebase(loadedTablebase, gameStateIndex(game))]);
         }
     }
     
     // Display available moves
-    if (!game.over) {
-        if (!game.turn) {
+    if (!game->over) {
+        if (!game->turn) {
             // Removal turn - show positions that can be removed
-            printf("\nRemovable positions: ");
+            appendFrame(frame, "\nRemovable positions: ");
             bool foundPositions = false;
             
             for (int y = 1; y <= GRID_SIZE; y++) {
                 for (int x = 1; x <= GRID_SIZE; x++) {
                     Position pos = {x, y};
-                    if (positionInSet(pos, game.Uno) || positionInSet(pos, game.Tres)) {
-                        printf("[%d,%d] ", x, y);
+                    if (positionInSet(pos, game->Uno) || positionInSet(pos, game->Tres)) {
+                        appendFrame(frame, "[%d,%d] ", x, y);
                         foundPositions = true;
                     }
                 }
             }
             
             if (!foundPositions) {
-                printf("None");
+                appendFrame(frame, "None");
             }
-            printf("\n");
+            appendFrame(frame, "\n");
         } else {
             // Placement turn - show free positions
-            printf("\nAvailable positions: \n");
-            for (int i = 0; i < game.F.size; i++) {
-                printf("[%d,%d] ", game.F.positions[i].x, game.F.positions[i].y);
-                if ((i + 1) % 8 == 0 && i < game.F.size - 1) {
-                    printf("\n"); // Align continued list
+            Position freePositions[MAX_POSITIONS];
+            int freeCount = setPositions(game->F, freePositions);
+            
+            appendFrame(frame, "\nAvailable positions: \n");
+            for (int i = 0; i < freeCount; i++) {
+                appendFrame(frame, "[%d,%d] ", freePositions[i].x, freePositions[i].y);
+                if ((i + 1) % 8 == 0 && i < freeCount - 1) {
+                    appendFrame(frame, "\n"); // Align continued list
                 }
             }
-            printf("\n\n");
+            appendFrame(frame, "\n\n");
+        }
+    }
+}
+
+/**
+ * Counts the terminal columns a piece of text takes up.
+ * @param text - The text.
+ * @param length - Number of bytes to look at.
+ * @return int - Printed characters, not counting ANSI escape sequences.
+ */
+int visibleWidth(const char* text, size_t length)
+{
+    int width = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '\033') {
+            // Skip to the final letter of the sequence
+            while (i + 1 < length && !((text[i + 1] >= 'A' && text[i + 1] <= 'Z')
+                                       || (text[i + 1] >= 'a' && text[i + 1] <= 'z'))) {
+                i++;
+            }
+            i++;
+        } else {
+            width++;
+        }
+    }
+    return width;
+}
+
+/**
+ * Appends what blanks the columns from the cursor on, leaving the cursor there.
+ * @param frame - The frame.
+ * @param columns - Number of columns; nothing is appended if it is not positive.
+ * @return void
+ * @details Uses the erase-characters sequence, which is shorter than spaces for
+ *          more than a few columns and stops at the given width, so boards to
+ *          the right are left alone.
+ */
+void eraseColumns(FrameBuffer* frame, int columns)
+{
+    if (columns > 4) {
+        appendFrame(frame, "\033[%dX", columns);
+    } else if (columns > 0) {
+        appendFrame(frame, "%*s", columns, "");
+    }
+}
+
+/**
+ * Sets up an empty view for the differential renderer.
+ * @param view - The view.
+ * @param row - Terminal row of the board's top-left corner, from 1.
+ * @param column - Terminal column of the board's top-left corner, from 1.
+ * @return void
+ */
+void initializeBoardView(BoardView* view, int row, int column)
+{
+    memset(view, 0, sizeof(*view));
+    view->row = row;
+    view->column = column;
+}
+
+/**
+ * Appends what has to be sent to bring a view up to date with a game state.
+ * @param frame - The frame; the output is appended to it.
+ * @param view - What was drawn last at the view's origin; updated.
+ * @param game - Pointer to the game state to show.
+ * @param status - Lines to show below the grid, each ending in a newline, or
+ *                 NULL for the ones renderGameStatus produces.
+ * @return void
+ * @details The first call draws the title, the coordinates and every cell.
+ *          Later calls send only cells whose owner changed and status lines
+ *          whose text changed, each preceded by a cursor move. The layout is
+ *          the one renderGame produces, and the cursor is left where its text
+ *          would end.
+ */
+void renderBoardChanges(FrameBuffer* frame, BoardView* view, GameState* game, const char* status)
+{
+    if (!view->drawn) {
+        appendFrame(frame, "\033[%d;%dH      GAME GRID", view->row, view->column);
+        appendFrame(frame, "\033[%d;%dH    ", view->row + 2, view->column);
+        for (int x = 1; x <= GRID_SIZE; x++) {
+            appendFrame(frame, "%d   ", x);
+        }
+        for (int y = 1; y <= GRID_SIZE; y++) {
+            appendFrame(frame, "\033[%d;%dH%d  ", view->row + 1 + 2 * y, view->column, y);
+        }
+    }
+    
+    // Cells
+    for (int cell = 0; cell < MAX_POSITIONS; cell++) {
+        Position pos = cellToPosition(cell);
+        uint8_t owner = positionInSet(pos, game->Uno) ? SET_UNO : positionInSet(pos, game->Tres) ? SET_TRES : SET_FREE;
+        if (view->drawn && view->cells[cell] == owner) {
+            continue;
+        }
+        appendFrame(frame, "\033[%d;%dH%s", view->row + 1 + 2 * pos.y, view->column + 3 + 4 * (pos.x - 1),
+                    owner == SET_UNO ? "\033[1;95m[U]\033[0m" : owner == SET_TRES ? "\033[1;94m[T]\033[0m" : "[ ]");
+        view->cells[cell] = owner;
+    }
+    
+    // Status lines, padded over whatever was wider before
+    FrameBuffer text;
+    text.length = 0;
+    if (status != NULL) {
+        appendFrame(&text, "%s", status);
+    } else {
+        renderGameStatus(&text, game);
+    }
+    text.data[text.length] = '\0';
+    
+    int count = 0;
+    const char* line = text.data;
+    for (const char* end; count < VIEW_MAX_LINES && (end = strchr(line, '\n')) != NULL; line = end + 1, count++) {
+        size_t length = (size_t)(end - line) < VIEW_LINE_LENGTH - 1 ? (size_t)(end - line) : VIEW_LINE_LENGTH - 1;
+        char* old = view->lines[count];
+        bool known = view->drawn && count < view->lineCount;
+        if (known && strlen(old) == length && memcmp(old, line, length) == 0) {
+            continue;
+        }
+        
+        // Skip the text both versions start with, backing up so no escape sequence is split
+        size_t same = 0, oldLength = strlen(old);
+        while (known && same < length && same < oldLength && old[same] == line[same]) {
+            same++;
+        }
+        for (size_t i = same; i-- > 0 && !((line[i] >= 'A' && line[i] <= 'Z') || (line[i] >= 'a' && line[i] <= 'z')); ) {
+            if (line[i] == '\033') {
+                same = i;
+                break;
+            }
+        }
+        int padding = (known ? visibleWidth(old, oldLength) : 0) - visibleWidth(line, length);
+        if (same < length || padding > 0) {
+            appendFrame(frame, "\033[%d;%dH%.*s", view->row + VIEW_STATUS_ROW + count,
+                        view->column + visibleWidth(line, same), (int)(length - same), line + same);
+            eraseColumns(frame, padding);
+        }
+        memcpy(old, line, length);
+        old[length] = '\0';
+    }
+    for (int i = count; view->drawn && i < view->lineCount; i++) {
+        appendFrame(frame, "\033[%d;%dH", view->row + VIEW_STATUS_ROW + i, view->column);
+        eraseColumns(frame, visibleWidth(view->lines[i], strlen(view->lines[i])));
+        view->lines[i][0] = '\0';
+    }
+    
+    view->lineCount = count;
+    view->drawn = true;
+    appendFrame(frame, "\033[%d;%dH", view->row + VIEW_STATUS_ROW + count, view->column);
+}
+
+/**
+ * Sends a frame to the terminal.
+ * @param frame - The frame.
+ * @return void
+ * @details Flushes stdout first so earlier printf output stays in order, then
+ *          writes the frame with one write call (repeated only if the
+ *          terminal accepts part of it).
+ */
+void writeFrame(FrameBuffer* frame)
+{
+    fflush(stdout);
+    #ifdef _WIN32
+        fwrite(frame->data, 1, frame->length, stdout);
+        fflush(stdout);
+    #else
+        size_t done = 0;
+        while (done < frame->length) {
+            ssize_t written = write(STDOUT_FILENO, frame->data + done, frame->length - done);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                break;
+            }
+            done += (size_t)written;
+        }
+    #endif
+}
+
+/**
+ * Measures how long frames take to build and how large they are.
+ * @param frames - Number of frames to build with each renderer.
+ * @return int - Process exit code.
+ * @details The frames follow random games move by move, starting a new game
+ *          when one ends, as the interactive display would show them. Full
+ *          frames redraw the screen; differential frames send the changes
+ *          from the previous frame of the same game. Nothing is written.
+ */
+int runRenderBenchmark(int frames)
+{
+    GameState* games = malloc(frames > 0 ? frames * sizeof(GameState) : 1);
+    BoardView view;
+    Rng rng;
+    uint64_t fullBytes = 0, diffBytes = 0;
+    
+    if (games == NULL) {
+        fprintf(stderr, "Not enough memory for the test positions.\n");
+        return 1;
+    }
+    seedRandom(&rng, 1);
+    for (int i = 0; i < frames; i++) {
+        if (i == 0 || games[i - 1].over) {
+            initializeGame(&games[i]);
+        } else {
+            games[i] = games[i - 1];
+            playMove(&games[i], cellToPosition(randomMoveCell(&games[i], &rng)));
+        }
+    }
+    
+    double start = wallSeconds();
+    for (int i = 0; i < frames; i++) {
+        renderGame(&screenFrame, &games[i]);
+        fullBytes += screenFrame.length;
+    }
+    double fullSeconds = wallSeconds() - start;
+    
+    start = wallSeconds();
+    for (int i = 0; i < frames; i++) {
+        if (games[i].moveCount == 0) {
+            initializeBoardView(&view, 1, 1);
+        }
+        screenFrame.length = 0;
+        renderBoardChanges(&screenFrame, &view, &games[i], NULL);
+        diffBytes += screenFrame.length;
+    }
+    double diffSeconds = wallSeconds() - start;
+    
+    printf("%d frames, one write each\n", frames);
+    printf("Full redraw:  %.2f us to build, %.0f bytes per frame\n",
+           frames > 0 ? fullSeconds * 1e6 / frames : 0.0, frames > 0 ? (double)fullBytes / frames : 0.0);
+    printf("Changes only: %.2f us to build, %.0f bytes per frame\n",
+           frames > 0 ? diffSeconds * 1e6 / frames : 0.0, frames > 0 ? (double)diffBytes / frames : 0.0);
+    free(games);
+    return 0;
+}
+
+/**
+ * Displays the current game state in the console.
+ * @param game - The current game state to display.
+ * @return void
+ * @details Clears the screen and draws the game in full the first time (and
+ *          every time when fullRedraw is set or on Windows); otherwise sends
+ *          only the changes, then erases the prompts and messages left below
+ *          the board. Either way the frame goes out in one write.
+ */
+void displayGame(GameState game)
+{
+    #ifdef _WIN32
+        clrscr();
+        renderGame(&screenFrame, &game);
+    #else
+        if (fullRedraw) {
+            renderGame(&screenFrame, &game);
+        } else {
+            screenFrame.length = 0;
+            if (!screenView.drawn) {
+                initializeBoardView(&screenView, 1, 1);
+                appendFrame(&screenFrame, FRAME_CLEAR);
+            }
+            renderBoardChanges(&screenFrame, &screenView, &game, NULL);
+            appendFrame(&screenFrame, "\033[J");
+        }
+    #endif
+    writeFrame(&screenFrame);
+}
+
+/* ------------------------------------------------------------------------
+ * Simulation monitor
+ *
+ * Tiles a sample of the games a simulation is playing on one screen. Every
+ * board belongs to one worker thread, which overwrites it after each move
+ * with the whole game packed into a single 64-bit word: Uno's and Tres's
+ * masks, the move count, the phase and the over flag. A plain atomic store
+ * of that word is the whole handoff, so workers never wait for the screen
+ * and the screen never sees half a move. The main thread wakes up at most
+ * MONITOR_FPS times a second, loads every word, and draws the boards whose
+ * word changed through their own BoardView, all in one write.
+ * ------------------------------------------------------------------------ */
+
+#define MONITOR_FPS 30
+#define MONITOR_TILE_WIDTH 24
+#define MONITOR_TILE_HEIGHT (VIEW_STATUS_ROW + 3)    // Grid, two status lines and a gap
+#define MONITOR_PUBLISHED (1ull << 51)              // Set in every packed word, so 0 means empty
+
+/**
+ * Packs what the monitor shows of a game into one word.
+ * @param game - Pointer to the game state.
+ * @return uint64_t - Uno's mask, Tres's mask, the move count, the phase and the over flag.
+ */
+uint64_t packMonitorState(GameState* game)
+{
+    return (uint64_t)setToMask(game->Uno) | (uint64_t)setToMask(game->Tres) << 16
+         | (uint64_t)(game->moveCount & 0xFFFF) << 32 | (uint64_t)gamePhase(game) << 48
+         | (uint64_t)game->over << 50 | MONITOR_PUBLISHED;
+}
+
+/**
+ * Rebuilds a game state from a word made by packMonitorState.
+ * @param state - The packed word.
+ * @param game - Receives the game state.
+ * @return void
+ * @details The over flag is taken from the word, so games stopped by the
+ *          move cap show as draws.
+ */
+void unpackMonitorState(uint64_t state, GameState* game)
+{
+    setGamePosition(game, (SetMask)state, (SetMask)(state >> 16), (Phase)((state >> 48) & 3));
+    game->moveCount = (uint32_t)((state >> 32) & 0xFFFF);
+    game->over = (state >> 50) & 1;
+}
+
+/**
+ * Appends the changes to the monitor's boards since they were last drawn.
+ * @param frame - The frame; the output is appended to it.
+ * @param monitor - The monitor the workers publish to.
+ * @param views - One view per board, at its tile's origin.
+ * @param shown - The word each board was last drawn from; updated.
+ * @param games - Number of games in the simulation, for the progress line.
+ * @return void
+ */
+void renderMonitor(FrameBuffer* frame, SimulationMonitor* monitor, BoardView* views, uint64_t* shown, uint64_t games)
+{
+    const char* players[4] = {"", "\033[1;95mUno\033[0m", "\033[1;94mTres\033[0m", "\033[1;91mDos\033[0m"};
+    
+    for (int b = 0; b < monitor->boards; b++) {
+        uint64_t state = __atomic_load_n(&monitor->slots[b].state, __ATOMIC_RELAXED);
+        if (views[b].drawn && state == shown[b]) {
+            continue;
+        }
+        
+        GameState game;
+        char status[VIEW_LINE_LENGTH];
+        if (state == 0) {
+            initializeGame(&game);
+            snprintf(status, sizeof(status), "Board %d\nWaiting\n", b + 1);
+        } else {
+            unpackMonitorState(state, &game);
+            Outcome winner = gameWinner(&game);
+            if (!game.over) {
+                snprintf(status, sizeof(status), "Board %d\nMove %u: %s\n", b + 1, game.moveCount,
+                         players[phasePlayer(gamePhase(&game))]);
+            } else if (winner == OUTCOME_NONE) {
+                snprintf(status, sizeof(status), "Board %d\nDraw after %u moves\n", b + 1, game.moveCount);
+            } else {
+                snprintf(status, sizeof(status), "Board %d\n%s wins in %u moves\n", b + 1, players[winner],
+                         game.moveCount);
+            }
+        }
+        renderBoardChanges(frame, &views[b], &game, status);
+        shown[b] = state;
+    }
+    
+    uint64_t done = __atomic_load_n(&monitor->gamesDone, __ATOMIC_RELAXED);
+    appendFrame(frame, "\033[%d;1H%llu of %llu games played\033[K", views[monitor->boards - 1].row + MONITOR_TILE_HEIGHT,
+                (unsigned long long)done, (unsigned long long)games);
+}
+
+/**
+ * Works out how the monitor's tiles fit in the terminal.
+ * @param perRow - Receives the number of tiles per row, or NULL.
+ * @return int - Number of tiles that fit on the screen, at least 1.
+ * @details A terminal of unknown size is taken to be 80x24. One line below
+ *          the tiles is kept for the games played count.
+ */
+int monitorLayout(int* perRow)
+{
+    int columns = 80, rows = 24;
+    
+    #ifndef _WIN32
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+            columns = size.ws_col;
+            rows = size.ws_row;
         }
+    #endif
+    int across = columns / MONITOR_TILE_WIDTH > 0 ? columns / MONITOR_TILE_WIDTH : 1;
+    int down = (rows - 1) / MONITOR_TILE_HEIGHT > 0 ? (rows - 1) / MONITOR_TILE_HEIGHT : 1;
+    if (perRow != NULL) {
+        *perRow = across;
+    }
+    return across * down;
+}
+
+/**
+ * Draws a simulation's boards until every game has been played.
+ * @param monitor - The monitor the workers publish to.
+ * @param games - Number of games in the simulation.
+ * @return void
+ * @details Clears the screen and lays the boards out in rows as wide as the
+ *          terminal (runSimulation only asks for as many as fit), then redraws the changed boards at most MONITOR_FPS
+ *          times a second. The last frame is drawn after the last game, so
+ *          it shows where every board's game ended.
+ */
+void watchSimulation(SimulationMonitor* monitor, uint64_t games)
+{
+    BoardView* views = malloc(monitor->boards * sizeof(BoardView));
+    uint64_t shown[MONITOR_MAX_BOARDS] = {0};
+    int perRow;
+    
+    if (views == NULL) {
+        return;
+    }
+    monitorLayout(&perRow);
+    for (int b = 0; b < monitor->boards; b++) {
+        initializeBoardView(&views[b], 1 + b / perRow * MONITOR_TILE_HEIGHT, 1 + b % perRow * MONITOR_TILE_WIDTH);
     }
     
+    screenFrame.length = 0;
+    appendFrame(&screenFrame, FRAME_CLEAR);
+    for (bool done = false; !done; ) {
+        double frameStart = wallSeconds();
+        // Acquire pairs with the workers' release, so the last frame has the last moves
+        done = __atomic_load_n(&monitor->gamesDone, __ATOMIC_ACQUIRE) >= games;
+        renderMonitor(&screenFrame, monitor, views, shown, games);
+        writeFrame(&screenFrame);
+        screenFrame.length = 0;
+        
+        double rest = 1.0 / MONITOR_FPS - (wallSeconds() - frameStart);
+        #ifndef _WIN32
+            if (!done && rest > 0) {
+                struct timespec pause = {0, (long)(rest * 1e9)};
+                nanosleep(&pause, NULL);
+            }
+        #endif
+    }
+    printf("\n\n");
+    free(views);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
     GameState game;
     int x, y;
     Position movePos;
     
+    // Build the pattern masks used by the win checks and the lookup tables
+    initializeWinningMasks();
+    initializeZobristKeys();
+    initializeSymmetries();
+    initializeStateIndex();
+    initializeBoardKernels();
+    
+    // A leading --size N picks the board for the tools that run on other sizes
+    int boardSize = GRID_SIZE;
+    if (argc > 2 && strcmp(argv[1], "--size") == 0) {
+        boardSize = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+        if (boardSize != GRID_SIZE && (argc < 2 || (strcmp(argv[1], "--simulate") != 0
+                                                    && strcmp(argv[1], "--perft") != 0))) {
+            fprintf(stderr, "Only --simulate and --perft run on boards other than %dx%d.\n", GRID_SIZE, GRID_SIZE);
+            return 1;
+        }
+    }
+    
+    // Command line tools
+    if (argc > 1 && strcmp(argv[1], "--solve") == 0) {
+        return runSolver(argc > 2 ? atoi(argv[2]) : cpuCount());
+    }
+    if (argc > 1 && strcmp(argv[1], "--solve-bench") == 0) {
+        return runSolverBenchmark(argc > 2 ? atoi(argv[2]) : cpuCount());
+    }
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        return runBatch(argc > 2 ? argv[2] : "-", true);
+    }
+    if (argc > 1 && strcmp(argv[1], "--batch-totals") == 0) {
+        return runBatch(argc > 2 ? argv[2] : "-", false);
+    }
+    if (argc > 3 && strcmp(argv[1], "--encode-records") == 0) {
+        return runEncodeRecords(argv[2], argv[3]);
+    }
+    if (argc > 2 && strcmp(argv[1], "--replay-records") == 0) {
+        return runReplayRecords(argv[2]);
+    }
+    if (argc > 2 && strcmp(argv[1], "--validate-records") == 0) {
+        return runValidateRecords(argv[2], argc > 3 ? atoi(argv[3]) : cpuCount());
+    }
+    if (argc > 1 && strcmp(argv[1], "--self-test") == 0) {
+        return runSelfTest(argc > 2 ? atoi(argv[2]) : 1000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--symmetry") == 0) {
+        return runSymmetryReport();
+    }
+    if (argc > 2 && strcmp(argv[1], "--build-tablebase") == 0) {
+        return runBuildTablebase(argv[2], argc > 3 ? atoi(argv[3]) : cpuCount());
+    }
+    if (argc > 2 && strcmp(argv[1], "--probe-tablebase") == 0) {
+        return runProbeTablebase(argv[2]);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "--ai-bench") == 0) {
+        return runSearchBenchmark(argc > 2 ? atoi(argv[2]) : 10, argc > 3 ? atof(argv[3]) / 1000 : 0.001,
+                                  argc > 4 ? atoi(argv[4]) : 1, argc > 5 ? (size_t)atoi(argv[5]) : 16);
+    }
+    if (argc > 1 && strcmp(argv[1], "--mcts-bench") == 0) {
+        return runMctsBenchmark(argc > 2 ? atoi(argv[2]) : 10, argc > 3 ? strtoull(argv[3], NULL, 10) : 10000,
+                                argc > 4 ? atof(argv[4]) / 1000 : 0, argc > 5 ? atoi(argv[5]) : 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "--simulate") == 0) {
+        return runSimulation(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000, argc > 3 ? atoi(argv[3]) : cpuCount(),
+                             argc > 4 ? strtoull(argv[4], NULL, 10) : 1, argc > 5 && strcmp(argv[5], "heuristic") == 0,
+                             argc > 6 ? atoi(argv[6]) : PLAYOUT_MAX_PLIES, argc > 7 ? atoi(argv[7]) : 0, boardSize);
+    }
+    if (argc > 1 && strcmp(argv[1], "--render-bench") == 0) {
+        return runRenderBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
+    }
+    if (argc > 2 && strcmp(argv[1], "--perft") == 0) {
+        return runPerft(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : cpuCount(),
+                        argc > 4 ? (size_t)atoi(argv[4]) : 0, argc > 5 ? argv[5] : NULL, boardSize);
+    }
+    if (argc > 1 && strcmp(argv[1], "--mcts-scaling") == 0) {
+        return runMctsScaling(argc > 2 ? atoi(argv[2]) : 200, argc > 3 ? strtoull(argv[3], NULL, 10) : 20000,
+                              argc > 4 ? atoi(argv[4]) : cpuCount(), argc > 5 ? argv[5] : NULL);
+    }
+    
+    // Game options: a tablebase to show solved outcomes, computer seats, the player they
+    // use (alpha-beta search or Monte Carlo), their budget per move, search threads,
+    // transposition table size, the draw rule and whether to redraw the full screen
+    Tablebase tablebase;
+    InputBuffer input;
+    PositionHistory history;
+    UndoStack undoStack = {.size = 0};
+    SharedTable table;
+    SearchEngine engines[4];
+    MctsPlayer mcts[SEARCH_MAX_THREADS];
+    bool computerSeat[4] = {false};
+    bool useMcts = false;
+    double thinkSeconds = 0.001;
+    uint64_t mctsPlayouts = 0;
+    int searchThreads = 1;
+    size_t tableMegabytes = 16;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--tablebase") == 0) {
+            if (!openTablebase(&tablebase, argv[i + 1])) {
+                fprintf(stderr, "%s is missing or was built for a different grid or patterns.\n", argv[i + 1]);
+                return 1;
+            }
+            loadedTablebase = &tablebase;
+        } else if (strcmp(argv[i], "--ai") == 0) {
+            computerSeat[OUTCOME_UNO] = strstr(argv[i + 1], "uno") || strcmp(argv[i + 1], "all") == 0;
+            computerSeat[OUTCOME_TRES] = strstr(argv[i + 1], "tres") || strcmp(argv[i + 1], "all") == 0;
+            computerSeat[OUTCOME_DOS] = strstr(argv[i + 1], "dos") || strcmp(argv[i + 1], "all") == 0;
+        } else if (strcmp(argv[i], "--think") == 0) {
+            thinkSeconds = atof(argv[i + 1]) / 1000;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            searchThreads = atoi(argv[i + 1]) < 1 ? 1 : atoi(argv[i + 1]) > SEARCH_MAX_THREADS
+                          ? SEARCH_MAX_THREADS : atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--hash") == 0) {
+            tableMegabytes = atoi(argv[i + 1]) > 0 ? (size_t)atoi(argv[i + 1]) : 1;
+        } else if (strcmp(argv[i], "--player") == 0) {
+            useMcts = strcmp(argv[i + 1], "mcts") == 0;
+        } else if (strcmp(argv[i], "--playouts") == 0) {
+            mctsPlayouts = strtoull(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--draw-moves") == 0) {
+            drawRule.maxMoves = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--draw-repetitions") == 0) {
+            drawRule.repetitions = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--redraw") == 0) {
+            fullRedraw = strcmp(argv[i + 1], "full") == 0;
+        }
+    }
+    for (int i = 0; useMcts && i < searchThreads; i++) {
+        if (!initializeMcts(&mcts[i], 64, (uint64_t)time(NULL) + i)) {
+            fprintf(stderr, "Not enough memory for the search trees.\n");
+            return 1;
+        }
+    }
+    if (!useMcts && (computerSeat[OUTCOME_UNO] || computerSeat[OUTCOME_TRES] || computerSeat[OUTCOME_DOS])) {
+        if (!initializeSharedTable(&table, tableMegabytes)) {
+            fprintf(stderr, "Not enough memory for the transposition table.\n");
+            return 1;
+        }
+        for (int player = OUTCOME_UNO; player <= OUTCOME_DOS; player++) {
+            initializeSearch(&engines[player], (Outcome)player, &table);
+        }
+    }
+    
+    openInput(&input, "-");
     printf("\n\n\n\n\n\n\n\n\n\n\n");
     printf("                                                      \033[1;94mTres\033[0m, \033[1;95mUno\033[0m, \033[1;91mDos\033[0m\n");
     printf("                                                    By Hadjj and Justin\n\n");
     printf("                                                  Press Enter to Continue");
-    getchar();
+    readInputByte(&input);
     // Initialize the game
     initializeGame(&game);
+    trackHistory(&game, &history);
     
     // Game loop
     while (!game.over) {
-        // Display current state
-        displayGame(game);
+        // Display current state, unless the next move has already been typed or piped in
+        Outcome mover = phasePlayer(gamePhase(&game));
+        bool waiting = !computerSeat[mover] && inputHasMove(&input);
+        if (!waiting) {
+            displayGame(game);
+        }
+        
+        // Let the engine move for computer seats
+        if (computerSeat[mover]) {
+            if (useMcts) {
+                // A playout budget replaces the time budget
+                mctsBestMove(mcts, searchThreads, &game, mctsPlayouts, mctsPlayouts ? 0 : thinkSeconds, &movePos);
+            } else {
+                searchBestMove(&engines[mover], &game, SEARCH_MAX_PLY, thinkSeconds, searchThreads, &movePos);
+            }
+            applyMove(&game, movePos, &undoStack);
+            continue;
+        }
         
         // Prompt for move
-        printf("Enter coordinates (x y): ");
-        if (scanf("%d %d", &x, &y) != 2) {
+        if (!waiting) {
+            printf("Enter coordinates (x y, or 0 0 to undo): ");
+        }
+        int read = readCoordinates(&input, &x, &y);
+        if (read == EOF) {
+            // The input ended, as a script does once its moves run out
+            printf("\n");
+            return 0;
+        }
+        if (read != 2) {
             // Clear input buffer if invalid input
-            while (getchar() != '\n');
+            skipInputLine(&input);
             printf("\n\\033[1;91mInvalid input! Please enter coordinates as two numbers (e.g., 1 2).\033[0m\n");
             printf("Press Enter to continue...");
-            getchar();
+            readInputByte(&input);
+            continue;
+        }
+        
+        // Take back the last move, and the computer seats' replies to it
+        if (x == 0 && y == 0) {
+            if (!undoMove(&game, &undoStack)) {
+                printf("\nNo moves to undo.\n");
+                printf("Press Enter to continue...");
+                readInputByte(&input); // Clear the newline
+                readInputByte(&input); // Wait for Enter
+                continue;
+            }
+            while (computerSeat[phasePlayer(gamePhase(&game))] && undoMove(&game, &undoStack));
             continue;
         }
         
@@ -390,33 +5880,30 @@ int main()
         if (x < 1 || x > GRID_SIZE || y < 1 || y > GRID_SIZE) {
             printf("\n\033[1;91mInvalid position! Coordinates must be between 1 and %d.\033[0m\n", GRID_SIZE);
             printf("Press Enter to continue...");
-            getchar(); // Clear the newline
-            getchar(); // Wait for Enter
+            readInputByte(&input); // Clear the newline
+            readInputByte(&input); // Wait for Enter
             continue;
         }
         
         movePos.x = x;
         movePos.y = y;
         
-        // Process the move
-        if (!nextPlayerMove(&game, movePos)) {
+        // Process the move, checking if the game is over after it
+        if (!applyMove(&game, movePos, &undoStack)) {
             printf("\nInvalid move! Try again.\n");
             printf("Press Enter to continue...");
-            getchar(); // Clear the newline
-            getchar(); // Wait for Enter
+            readInputByte(&input); // Clear the newline
+            readInputByte(&input); // Wait for Enter
             continue;
         }
-        
-        // Check if game is over after the move
-        checkGameOver(&game);
     }
     
     // Show final state
     displayGame(game);
     
     printf("Game Over! Press Enter to exit...");
-    getchar(); // Clear the newline
-    getchar(); // Wait for Enter
+    readInputByte(&input); // Clear the newline
+    readInputByte(&input); // Wait for Enter
     
     return 0;
 }
\ No newline at end of file